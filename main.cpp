@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <iostream>
 #include <sample_scene.hpp>
 #include <application/application.hpp>
@@ -11,16 +12,31 @@ int main(int, char **) {
     game_window.maximized = true;
     game_window.width = 1280;
     game_window.height = 720;
+    game_window.vsync = true;
 
     auto scene = std::make_shared<Scene>();
+    auto overlay = std::make_shared<StatsOverlay>(scene->GetStats());
 
-    app.CreateWindow(game_window, {scene}, {scene});
+    app.CreateWindow(game_window, {scene, overlay}, {scene});
+    app.SetTargetFps(120); // in case vsync is not available
+
+    // LITWORLD_METRICS=9100 or LITWORLD_METRICS=/tmp/litworld.sock exports the world stats for Prometheus
+    MetricsServer metrics;
+    if (const char *address = std::getenv("LITWORLD_METRICS")) {
+        if (metrics.start(address)) {
+            scene->ExportMetrics(&metrics);
+        } else {
+            std::cerr << "Can't start metrics server at " << address << std::endl;
+        }
+    }
 
 
     while (app.AnyWindowAlive()) {
         app.PollEvents();
         app.Redraw();
+        app.WaitNextFrame();
     }
+    scene->GetStats().Dump(std::cout);
 
     return 0;
 }
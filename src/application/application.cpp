@@ -42,10 +42,14 @@ bool Application::CreateWindow(const WindowInfo &window_info,
 void Application::PollEvents() {
     SDL_Event e;
     while (SDL_PollEvent(&e) != 0) {
-        for (auto &window : windows) {
-            if (window.ProcessEvent(e)) {
-                break;
-            }
+        DispatchEvent(e);
+    }
+}
+
+void Application::DispatchEvent(const SDL_Event &event) {
+    for (auto &window : windows) {
+        if (window.ProcessEvent(event)) {
+            break;
         }
     }
 }
@@ -59,6 +63,37 @@ bool Application::AnyWindowAlive() const {
     return false;
 }
 
+bool Application::AnyWindowNeedsRedraw() const {
+    for (const auto &w : windows) {
+        if (w.NeedsRedraw()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Application::SetTargetFps(double fps) {
+    target_fps = fps;
+}
+
+void Application::WaitNextFrame() {
+    if (!AnyWindowNeedsRedraw()) {
+        SDL_Event e;
+        if (SDL_WaitEventTimeout(&e, kIdleTimeoutMs) != 0) {
+            DispatchEvent(e);
+        }
+        frame_timer.reset();
+        return;
+    }
+    if (target_fps > 0.0) {
+        double remaining = 1.0 / target_fps - frame_timer.get_elapsed_seconds();
+        if (remaining > 0.0) {
+            SDL_Delay((Uint32) (remaining * 1000.0));
+        }
+    }
+    frame_timer.reset();
+}
+
 void Application::Redraw() {
     for (auto &w : windows) {
         w.Redraw();
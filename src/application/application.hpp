@@ -5,6 +5,7 @@
 #include <memory>
 #include <vector>
 #include "window.hpp"
+#include "time_utils.hpp"
 
 class Application {
 public:
@@ -26,9 +27,26 @@ public:
 
     bool AnyWindowAlive() const;
 
+    // Limits the frame rate when vsync is off, 0 - no limit
+    void SetTargetFps(double fps);
+
+    // Call after Redraw: sleeps until the next frame is due, or waits for an event
+    // while no window needs a redraw (minimized, hidden or nothing changed)
+    void WaitNextFrame();
+
 private:
+    void DispatchEvent(const SDL_Event &event);
+
+    bool AnyWindowNeedsRedraw() const;
+
     bool initialized = false;
 
+    double target_fps = 0.0;
+    lit::common::timer frame_timer;
+
+    // Idle wait is not endless, so renderers that change on their own are polled from time to time
+    static constexpr int kIdleTimeoutMs = 100;
+
     std::vector<Window> windows;
 
 };
@@ -0,0 +1,104 @@
+#include "stats_overlay.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <GL/glew.h>
+
+namespace {
+
+    const double k_budget_seconds = 1.0 / 60.0;
+    const float k_bar_width = 240.0f; // pixels for two budgets
+    const float k_bar_height = 6.0f;
+
+}
+
+void FrameStats::SetCounter(const char *name, double value) {
+    for (auto &c : counters) {
+        if (c.first == name) {
+            c.second = value;
+            return;
+        }
+    }
+    counters.emplace_back(name, value);
+}
+
+void FrameStats::Dump(std::ostream &out) const {
+    frame.get_total().print(out, "frame");
+    physics.get_total().print(out, "physics");
+    render.get_total().print(out, "render");
+    for (const auto &c : counters) {
+        out << c.first << ": " << c.second << "\n";
+    }
+}
+
+StatsOverlay::StatsOverlay(const FrameStats &stats) : stats(stats) {}
+
+bool StatsOverlay::Init(SDL_Window *window, SDL_GLContext) {
+    sdl_window = window;
+    title = SDL_GetWindowTitle(window);
+    return true;
+}
+
+void StatsOverlay::Redraw() {
+    SDL_GetWindowSize(sdl_window, &width, &height);
+    glLoadIdentity();
+    glOrtho(0, width, height, 0, 0, 1);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glColor4f(0.0f, 0.0f, 0.0f, 0.6f);
+    glBegin(GL_QUADS);
+    glVertex2f(5, 5);
+    glVertex2f(15 + k_bar_width, 5);
+    glVertex2f(15 + k_bar_width, 15 + 3 * 5 * k_bar_height);
+    glVertex2f(5, 15 + 3 * 5 * k_bar_height);
+    glEnd();
+
+    DrawBars(stats.frame.get_recent(), 10);
+    DrawBars(stats.physics.get_recent(), 10 + 5 * k_bar_height);
+    DrawBars(stats.render.get_recent(), 10 + 10 * k_bar_height);
+
+    // Budget of one 60 FPS frame
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glBegin(GL_LINES);
+    glVertex2f(10 + k_bar_width / 2, 5);
+    glVertex2f(10 + k_bar_width / 2, 15 + 3 * 5 * k_bar_height);
+    glEnd();
+
+    if (title_timer.get_elapsed_seconds() > 0.5) {
+        title_timer.reset();
+        UpdateTitle();
+    }
+}
+
+bool StatsOverlay::NeedsRedraw() {
+    return false;
+}
+
+void StatsOverlay::DrawBars(const lit::common::latency_histogram &histogram, float y) {
+    // p50, p95, p99 and max, from green to red
+    const double values[4] = {histogram.get_percentile(50), histogram.get_percentile(95),
+                              histogram.get_percentile(99), histogram.get_max()};
+    const float colors[4][3] = {{0.3f, 0.9f, 0.3f}, {0.9f, 0.9f, 0.3f}, {1.0f, 0.6f, 0.2f}, {1.0f, 0.25f, 0.25f}};
+    for (int i = 0; i < 4; i++) {
+        float bar = std::min((float) (values[i] / (2 * k_budget_seconds)), 1.0f) * k_bar_width;
+        float top = y + i * k_bar_height;
+        glColor3f(colors[i][0], colors[i][1], colors[i][2]);
+        glBegin(GL_QUADS);
+        glVertex2f(10, top);
+        glVertex2f(10 + bar, top);
+        glVertex2f(10 + bar, top + k_bar_height - 1);
+        glVertex2f(10, top + k_bar_height - 1);
+        glEnd();
+    }
+}
+
+void StatsOverlay::UpdateTitle() {
+    std::ostringstream text;
+    text << title << std::fixed << std::setprecision(1)
+         << " | frame p99 " << stats.frame.get_recent().get_percentile(99) * 1000.0 << " ms";
+    for (const auto &c : stats.counters) {
+        text << " | " << c.first << " " << std::setprecision(0) << c.second;
+    }
+    SDL_SetWindowTitle(sdl_window, text.str().c_str());
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "time_utils.hpp"
+#include "window_renderer.hpp"
+
+// Timings and counters of the running scene, filled by the scene every frame
+struct FrameStats {
+    lit::common::rolling_latency_histogram frame;
+    lit::common::rolling_latency_histogram physics;
+    lit::common::rolling_latency_histogram render;
+
+    std::vector<std::pair<std::string, double>> counters; // name, current value
+
+    void SetCounter(const char *name, double value);
+
+    // Text dump of the whole session, for headless runs and the end of the session
+    void Dump(std::ostream &out) const;
+};
+
+// Draws p50/p95/p99/max of the recent frame, physics and render time as bars in the top left corner
+// against a 60 FPS budget line, counters are shown in the window title. Add it after the scene renderer.
+class StatsOverlay : public WindowRenderer {
+public:
+    explicit StatsOverlay(const FrameStats &stats);
+
+    bool Init(SDL_Window *window, SDL_GLContext context) override;
+
+    void Redraw() override;
+
+    // Shows the frames of other renderers, does not keep the window awake by itself
+    bool NeedsRedraw() override;
+
+private:
+    void DrawBars(const lit::common::latency_histogram &histogram, float y);
+
+    void UpdateTitle();
+
+    const FrameStats &stats;
+    SDL_Window *sdl_window = nullptr;
+    std::string title;
+    lit::common::timer title_timer;
+
+    int width = 512;
+    int height = 512;
+};
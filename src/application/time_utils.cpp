@@ -1,22 +1,24 @@
 #include "time_utils.hpp"
-#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
 
 using namespace lit::common;
 
 typedef std::chrono::duration<double, std::ratio<1> > second_;
 
 timer::timer() {
-    m_start_time = std::chrono::high_resolution_clock::now();
+    m_start_time = std::chrono::steady_clock::now();
 }
 
 double timer::get_elapsed_seconds() {
-    auto cur_time = std::chrono::high_resolution_clock::now();
+    auto cur_time = std::chrono::steady_clock::now();
     auto delta = std::chrono::duration_cast<second_>(cur_time - m_start_time).count();
     return delta;
 }
 
 void timer::reset() {
-    m_start_time = std::chrono::high_resolution_clock::now();
+    m_start_time = std::chrono::steady_clock::now();
 }
 
 double fps_timer::get_average_fps() const {
@@ -47,5 +49,102 @@ void fps_timer::frame_end() {
         m_times.pop();
     }
     m_times.push((m_times.empty() ? 0 : m_times.back()) + time);
+    m_histogram.record(time);
     m_frame_started = false;
 }
+
+const latency_histogram &fps_timer::get_histogram() const {
+    return m_histogram;
+}
+
+size_t latency_histogram::get_bucket(uint64_t microseconds) {
+    // Values below 2 * kSubBuckets are exact, above them a bucket covers 2^shift microseconds
+    int shift = 0;
+    while ((microseconds >> shift) >= 2 * kSubBuckets && shift < kMaxShift) {
+        shift++;
+    }
+    uint64_t sub_bucket = std::min<uint64_t>(microseconds >> shift, 2 * kSubBuckets - 1);
+    return shift * kSubBuckets + sub_bucket;
+}
+
+double latency_histogram::get_bucket_value(size_t bucket) {
+    size_t shift = bucket < 2 * kSubBuckets ? 0 : bucket / kSubBuckets - 1;
+    uint64_t sub_bucket = bucket - shift * kSubBuckets;
+    uint64_t low = sub_bucket << shift;
+    return (low + ((uint64_t(1) << shift) - 1) * 0.5) * 1e-6; // middle of the bucket
+}
+
+void latency_histogram::record(double seconds) {
+    auto microseconds = (uint64_t) std::llround(std::max(seconds, 0.0) * 1e6);
+    m_counts[get_bucket(microseconds)]++;
+    m_count++;
+    m_max = std::max(m_max, microseconds);
+}
+
+void latency_histogram::reset() {
+    m_counts.fill(0);
+    m_count = 0;
+    m_max = 0;
+}
+
+uint64_t latency_histogram::get_count() const {
+    return m_count;
+}
+
+double latency_histogram::get_percentile(double percentile) const {
+    if (m_count == 0) {
+        return 0;
+    }
+    auto rank = (uint64_t) std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * m_count);
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < m_counts.size(); i++) {
+        seen += m_counts[i];
+        if (seen >= rank) {
+            return std::min(get_bucket_value(i), get_max());
+        }
+    }
+    return get_max();
+}
+
+double latency_histogram::get_max() const {
+    return m_max * 1e-6;
+}
+
+void latency_histogram::print(std::ostream &out, const char *name) const {
+    auto flags = out.flags();
+    auto precision = out.precision();
+    out << std::fixed << std::setprecision(2) << name
+        << ": p50 " << get_percentile(50) * 1000.0 << " ms"
+        << ", p95 " << get_percentile(95) * 1000.0 << " ms"
+        << ", p99 " << get_percentile(99) * 1000.0 << " ms"
+        << ", max " << get_max() * 1000.0 << " ms"
+        << " (" << m_count << " samples)\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+rolling_latency_histogram::rolling_latency_histogram(double window_seconds) : m_window_seconds(window_seconds) {}
+
+void rolling_latency_histogram::record(double seconds) {
+    double elapsed = m_window_timer.get_elapsed_seconds();
+    if (elapsed >= m_window_seconds) {
+        m_window_timer.reset();
+        m_current = 1 - m_current;
+        m_windows[m_current].reset();
+        m_rotated = true;
+        if (elapsed >= 2 * m_window_seconds) {
+            m_windows[1 - m_current].reset(); // nothing was recorded for a whole window, the old one is stale
+        }
+    }
+    m_windows[m_current].record(seconds);
+    m_total.record(seconds);
+}
+
+const latency_histogram &rolling_latency_histogram::get_recent() const {
+    return m_rotated ? m_windows[1 - m_current] : m_windows[m_current];
+}
+
+const latency_histogram &rolling_latency_histogram::get_total() const {
+    return m_total;
+}
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <cstdint>
+#include <ostream>
 #include <queue>
 
 namespace lit::common {
@@ -14,11 +17,79 @@ namespace lit::common {
         double get_elapsed_seconds();
 
     private:
-        #ifdef _MSC_VER
         std::chrono::steady_clock::time_point m_start_time;
-        #else
-        std::chrono::system_clock::time_point m_start_time;
-        #endif
+    };
+
+    // Latency distribution with bounded relative error (HDR histogram style): values are counted in microseconds,
+    // every power of two range is split into kSubBuckets linear buckets, so percentiles are within ~3%.
+    // Fixed size, recording never allocates.
+    class latency_histogram {
+    public:
+        latency_histogram() = default;
+
+        void record(double seconds);
+
+        void reset();
+
+        [[nodiscard]] uint64_t get_count() const;
+
+        // percentile in [0; 100], result in seconds
+        [[nodiscard]] double get_percentile(double percentile) const;
+
+        [[nodiscard]] double get_max() const;
+
+        // "name: p50 1.20 ms, p95 ..., p99 ..., max ... (N samples)"
+        void print(std::ostream &out, const char *name) const;
+
+    private:
+        static constexpr int kSubBucketBits = 5;
+        static constexpr int kSubBuckets = 1 << kSubBucketBits;
+        static constexpr int kMaxShift = 32; // up to ~38 hours
+
+        static size_t get_bucket(uint64_t microseconds);
+
+        static double get_bucket_value(size_t bucket);
+
+        std::array<uint64_t, (kMaxShift + 2) * kSubBuckets> m_counts{};
+        uint64_t m_count = 0;
+        uint64_t m_max = 0;
+    };
+
+    // Whole session plus a rolling window: two histograms, the current one is cleared and becomes the recent
+    // one every window_seconds, so the recent percentiles follow the frame times of the last few seconds
+    class rolling_latency_histogram {
+    public:
+        explicit rolling_latency_histogram(double window_seconds = 2.0);
+
+        void record(double seconds);
+
+        // Last full window, the current one until the first window is over
+        [[nodiscard]] const latency_histogram &get_recent() const;
+
+        [[nodiscard]] const latency_histogram &get_total() const;
+
+    private:
+        double m_window_seconds;
+        std::array<latency_histogram, 2> m_windows;
+        size_t m_current = 0;
+        bool m_rotated = false;
+        latency_histogram m_total;
+        timer m_window_timer;
+    };
+
+    // Records the time of its scope into a histogram (latency_histogram or rolling_latency_histogram)
+    template<typename Histogram>
+    class scoped_timer {
+    public:
+        explicit scoped_timer(Histogram &histogram) : m_histogram(histogram) {}
+
+        ~scoped_timer() {
+            m_histogram.record(m_timer.get_elapsed_seconds());
+        }
+
+    private:
+        Histogram &m_histogram;
+        timer m_timer;
     };
 
     class fps_timer {
@@ -33,6 +104,8 @@ namespace lit::common {
 
         [[nodiscard]] double get_average_ms() const;
 
+        [[nodiscard]] const latency_histogram &get_histogram() const;
+
     private:
         const int kMaxFramesCount = 60;
 
@@ -40,6 +113,8 @@ namespace lit::common {
 
         std::queue<double> m_times;
 
+        latency_histogram m_histogram;
+
         timer m_timer;
     };
 
@@ -29,7 +29,11 @@ bool Window::Init() {
         return false;
     }
     glewInit();
-    SDL_GL_SetSwapInterval(0);
+    if (!info.vsync) {
+        SDL_GL_SetSwapInterval(0);
+    } else if (SDL_GL_SetSwapInterval(-1) != 0) {
+        SDL_GL_SetSwapInterval(1);
+    }
     glClearColor(0, 0, 0, 0);
     return initialized = true;
 }
@@ -43,11 +47,29 @@ bool Window::ProcessEvent(const SDL_Event &event) {
     auto my_id = SDL_GetWindowID(sdl_window);
 
     if (event.type == SDL_WINDOWEVENT && event.window.windowID == my_id) {
-        if (event.window.event == SDL_WINDOWEVENT_CLOSE) {
-            SDL_DestroyWindow(sdl_window);
-            sdl_window = nullptr;
-            closed = true;
+        switch (event.window.event) {
+            case SDL_WINDOWEVENT_CLOSE:
+                SDL_DestroyWindow(sdl_window);
+                sdl_window = nullptr;
+                closed = true;
+                break;
+            case SDL_WINDOWEVENT_MINIMIZED:
+                minimized = true;
+                break;
+            case SDL_WINDOWEVENT_HIDDEN:
+                hidden = true;
+                break;
+            case SDL_WINDOWEVENT_RESTORED:
+            case SDL_WINDOWEVENT_MAXIMIZED:
+                minimized = false;
+                break;
+            case SDL_WINDOWEVENT_SHOWN:
+                hidden = false;
+                break;
+            default:
+                break;
         }
+        dirty = true; // exposed, resized etc.
         return true;
     }
 
@@ -66,6 +88,9 @@ Window::Window(Window &&window) noexcept {
     std::swap(gl_context, window.gl_context);
     std::swap(initialized, window.initialized);
     std::swap(closed, window.closed);
+    std::swap(minimized, window.minimized);
+    std::swap(hidden, window.hidden);
+    std::swap(dirty, window.dirty);
     std::swap(renderers, window.renderers);
     std::swap(listeners, window.listeners);
 }
@@ -74,10 +99,26 @@ bool Window::IsClosed() const {
     return closed;
 }
 
+bool Window::NeedsRedraw() const {
+    if (!initialized || closed || minimized || hidden) {
+        return false;
+    }
+    if (dirty) {
+        return true;
+    }
+    for (auto &r : renderers) {
+        if (r->NeedsRedraw()) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void Window::Redraw() {
-    if (!initialized || closed) {
+    if (!NeedsRedraw()) {
         return;
     }
+    dirty = false;
 
     for (auto &l : listeners) {
         l->StartFrameEvent();
@@ -13,6 +13,7 @@ struct WindowInfo {
     int height = 600;
     bool maximized = true;
     bool resizable = true;
+    bool vsync = false; // adaptive if the driver supports it
 };
 
 class Window {
@@ -35,6 +36,9 @@ public:
 
     bool IsClosed() const;
 
+    // Visible and either the contents changed or the window was exposed/resized
+    bool NeedsRedraw() const;
+
     void AddRenderer(std::shared_ptr<WindowRenderer> renderer);
 
     void AddListener(std::shared_ptr<WindowListener> listener);
@@ -47,6 +51,9 @@ private:
 
     bool initialized = false;
     bool closed = false;
+    bool minimized = false;
+    bool hidden = false;
+    bool dirty = true; // has to be redrawn regardless of the renderers
 
     std::vector<std::shared_ptr<WindowRenderer>> renderers;
     std::vector<std::shared_ptr<WindowListener>> listeners;
@@ -11,4 +11,9 @@ public:
     virtual bool Init(SDL_Window *window, SDL_GLContext context) = 0;
 
     virtual void Redraw() = 0;
+
+    // Window is redrawn only when some of its renderers changed since the last frame
+    virtual bool NeedsRedraw() {
+        return true;
+    }
 };
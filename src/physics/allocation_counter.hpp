@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+
+// Number of global operator new calls made by the current thread. They are counted only in builds
+// with LIT_TRACK_ALLOCATIONS (it replaces the global operator new), otherwise it is always 0.
+// Standard containers allocate through operator new, direct malloc calls are not counted.
+size_t allocation_count();
+
+// Asserts that nothing is allocated in its scope, e.g. in a steady-state World::update
+class NoAllocationGuard {
+public:
+    explicit NoAllocationGuard(bool enabled = true) : enabled(enabled), start(allocation_count()) {}
+
+    NoAllocationGuard(const NoAllocationGuard &) = delete;
+
+    ~NoAllocationGuard() {
+        assert((!enabled || allocation_count() == start) && "allocation in an allocation-free scope");
+    }
+
+private:
+    bool enabled;
+    size_t start;
+};
@@ -0,0 +1,42 @@
+#include "arena.hpp"
+
+#include <algorithm>
+
+FrameArena::FrameArena(size_t block_size) : block_size(block_size) {}
+
+void *FrameArena::allocate(size_t size, size_t alignment) {
+    if (!block) {
+        block.reset(new uint8_t[block_size]);
+    }
+    auto base = reinterpret_cast<uintptr_t>(block.get());
+    size_t start = (base + offset + alignment - 1) / alignment * alignment - base;
+    if (start + size <= block_size) {
+        offset = start + size;
+        return block.get() + start;
+    }
+
+    // Does not fit - separate block until the next reset
+    overflow.emplace_back(new uint8_t[size + alignment]);
+    overflow_size += size + alignment;
+    auto address = reinterpret_cast<uintptr_t>(overflow.back().get());
+    return reinterpret_cast<void *>((address + alignment - 1) / alignment * alignment);
+}
+
+void FrameArena::reset() {
+    if (!overflow.empty()) {
+        // Twice the peak usage, so the next steps have some room to grow
+        block_size = std::max(block_size, (offset + overflow_size) * 2);
+        block.reset();
+        overflow.clear();
+        overflow_size = 0;
+    }
+    offset = 0;
+}
+
+size_t FrameArena::used() const {
+    return offset + overflow_size;
+}
+
+size_t FrameArena::capacity() const {
+    return block ? block_size : 0;
+}
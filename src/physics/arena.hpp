@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for temporary data of one step or one frame: allocation moves a pointer,
+// reset frees everything at once. When a step needs more than the block, extra blocks are taken
+// from the heap and replaced by one bigger block on the next reset, so the arena stops allocating
+// as soon as the usage stops growing.
+class FrameArena {
+public:
+    explicit FrameArena(size_t block_size = 256 * 1024);
+
+    FrameArena(const FrameArena &) = delete;
+
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    // Uninitialized memory for count objects, valid until the next reset
+    template<typename T>
+    T *allocate_array(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena never calls destructors");
+        return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void reset();
+
+    size_t used() const;
+
+    size_t capacity() const;
+
+private:
+    std::unique_ptr<uint8_t[]> block;
+    size_t block_size = 0;
+    size_t offset = 0;
+
+    std::vector<std::unique_ptr<uint8_t[]>> overflow;
+    size_t overflow_size = 0;
+};
+
+// Standard allocator over a FrameArena, deallocate does nothing
+template<typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    explicit ArenaAllocator(FrameArena &arena) : arena(&arena) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t count) {
+        return static_cast<T *>(arena->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t) {}
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U> &other) const {
+        return arena == other.arena;
+    }
+
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const {
+        return arena != other.arena;
+    }
+
+    FrameArena *arena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,30 @@
+#include "batch.hpp"
+
+WorldBatch::WorldBatch(size_t threads_count) : pool(threads_count) {}
+
+void WorldBatch::create(size_t count,
+                        std::shared_ptr<const std::vector<Box>> level,
+                        const std::function<void(World &, size_t)> &setup) {
+    size_t start = worlds.size();
+    for (size_t i = start; i < start + count; i++) {
+        worlds.push_back(std::make_unique<World>());
+        worlds.back()->shared_boxes = level;
+    }
+    steppers.resize(worlds.size());
+
+    for (size_t i = start; i < worlds.size(); i++) {
+        pool.submit([this, &setup, i]() { setup(*worlds[i], i); });
+    }
+    pool.wait();
+}
+
+void WorldBatch::run(int frames, float delta_time) {
+    for (size_t i = 0; i < worlds.size(); i++) {
+        pool.submit([this, i, frames, delta_time]() {
+            for (int frame = 0; frame < frames; frame++) {
+                steppers[i].update(*worlds[i], delta_time);
+            }
+        });
+    }
+    pool.wait();
+}
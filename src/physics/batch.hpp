@@ -0,0 +1,55 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "model.hpp"
+#include "stepping.hpp"
+#include "thread_pool.hpp"
+
+// Many small independent worlds (e.g. a parameter sweep) stepped in one process on a work-stealing pool.
+// Level geometry is shared read-only between the worlds.
+struct WorldBatch {
+
+    explicit WorldBatch(size_t threads_count = 0);
+
+    // Creates count worlds that share the level, setup(world, index) spawns the rest and sets parameters.
+    // setup runs on the pool threads concurrently for different worlds, so it must be thread-safe
+    void create(size_t count,
+                std::shared_ptr<const std::vector<Box>> level,
+                const std::function<void(World &, size_t)> &setup);
+
+    // Advances every world by frames frames of delta_time, one task per world
+    void run(int frames, float delta_time);
+
+    // Evaluates collect(world, index) for every world on the pool, concurrently for different worlds
+    template<typename F>
+    auto collect(F &&collect) -> std::vector<decltype(collect(std::declval<const World &>(), size_t()))>;
+
+    std::vector<std::unique_ptr<World>> worlds; // World is not movable - volumes and the grid point into its particles
+    std::vector<StepController> steppers;
+
+    ThreadPool pool;
+};
+
+template<typename F>
+auto WorldBatch::collect(F &&collect) -> std::vector<decltype(collect(std::declval<const World &>(), size_t()))> {
+    using Result = decltype(collect(std::declval<const World &>(), size_t()));
+    // Every thread writes its own object - elements of std::vector<bool> share bytes
+    struct Slot {
+        Result value;
+    };
+    std::unique_ptr<Slot[]> slots(new Slot[worlds.size()]);
+    for (size_t i = 0; i < worlds.size(); i++) {
+        pool.submit([&, i]() { slots[i].value = collect(*worlds[i], i); });
+    }
+    pool.wait();
+
+    std::vector<Result> results;
+    results.reserve(worlds.size());
+    for (size_t i = 0; i < worlds.size(); i++) {
+        results.push_back(std::move(slots[i].value));
+    }
+    return results;
+}
@@ -1,6 +1,7 @@
 #pragma once
 // We are using glm library, but we also need some specific 2d functions that are not available in glm
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 
 using namespace glm;
 
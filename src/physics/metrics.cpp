@@ -0,0 +1,239 @@
+#include "metrics.hpp"
+
+#include <cstdio>
+
+#ifdef __unix__
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#endif
+
+namespace {
+
+    const char *const k_phase_names[] = {"grid", "particle_collisions", "box_collisions", "contacts",
+                                         "joints", "volumes", "integrate"};
+
+    float phase_time(const PhaseTimes &times, int phase) {
+        const float values[] = {times.grid, times.particle_collisions, times.box_collisions, times.contacts,
+                                times.joints, times.volumes, times.integrate};
+        return values[phase];
+    }
+
+    void add(std::atomic<double> &value, double delta) {
+        // Only the simulation thread writes, so load + store is enough
+        value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    void append_metric(std::string &out, const char *name, const char *type, const char *help) {
+        out += "# HELP ";
+        out += name;
+        out += ' ';
+        out += help;
+        out += "\n# TYPE ";
+        out += name;
+        out += ' ';
+        out += type;
+        out += '\n';
+    }
+
+    void append_value(std::string &out, const char *name, const char *labels, double value) {
+        char line[256];
+        std::snprintf(line, sizeof(line), "%s%s %.9g\n", name, labels, value);
+        out += line;
+    }
+
+}
+
+void MetricsServer::record(const World &world) {
+    const WorldStats &stats = world.stats;
+    auto relaxed = std::memory_order_relaxed;
+
+    steps.store(steps.load(relaxed) + 1, relaxed);
+    for (int i = 0; i < k_phases; i++) {
+        add(phase_seconds[i], phase_time(stats.phase_times, i));
+    }
+    live_particles.store(stats.live_particles, relaxed);
+    dead_particles.store(stats.dead_particles, relaxed);
+    contacts.store(stats.contacts, relaxed);
+    joints.store(stats.joints, relaxed);
+    volumes.store(stats.volumes, relaxed);
+    substeps.store(stats.substeps, relaxed);
+
+    // Steps per second of wall time, over windows of at least a second
+    auto now = std::chrono::steady_clock::now();
+    if (rate_steps == 0) {
+        rate_start = now;
+    }
+    rate_steps++;
+    double elapsed = std::chrono::duration<double>(now - rate_start).count();
+    if (elapsed >= 1.0) {
+        step_rate.store((rate_steps - 1) / elapsed, relaxed);
+        rate_steps = 1;
+        rate_start = now;
+    }
+}
+
+std::string MetricsServer::text() const {
+    auto relaxed = std::memory_order_relaxed;
+    std::string out;
+
+    append_metric(out, "litworld_steps_total", "counter", "World updates since the start.");
+    append_value(out, "litworld_steps_total", "", (double) steps.load(relaxed));
+
+    append_metric(out, "litworld_step_rate", "gauge", "World updates per second.");
+    append_value(out, "litworld_step_rate", "", step_rate.load(relaxed));
+
+    append_metric(out, "litworld_phase_seconds_total", "counter", "Time spent in the phases of World::update.");
+    for (int i = 0; i < k_phases; i++) {
+        std::string labels = std::string("{phase=\"") + k_phase_names[i] + "\"}";
+        append_value(out, "litworld_phase_seconds_total", labels.c_str(), phase_seconds[i].load(relaxed));
+    }
+
+    append_metric(out, "litworld_particles", "gauge", "Particles in the world.");
+    append_value(out, "litworld_particles", "{state=\"live\"}", (double) live_particles.load(relaxed));
+    append_value(out, "litworld_particles", "{state=\"dead\"}", (double) dead_particles.load(relaxed));
+
+    append_metric(out, "litworld_contacts", "gauge", "Contacts found in the last step.");
+    append_value(out, "litworld_contacts", "", (double) contacts.load(relaxed));
+
+    append_metric(out, "litworld_joints", "gauge", "Joints in the world.");
+    append_value(out, "litworld_joints", "", (double) joints.load(relaxed));
+
+    append_metric(out, "litworld_volumes", "gauge", "Inflated bodies in the world.");
+    append_value(out, "litworld_volumes", "", (double) volumes.load(relaxed));
+
+    append_metric(out, "litworld_substeps", "gauge", "Sub-steps of the last frame.");
+    append_value(out, "litworld_substeps", "", substeps.load(relaxed));
+    return out;
+}
+
+#ifdef __unix__
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start(const std::string &address) {
+    if (running) {
+        return false;
+    }
+
+    bool is_port = !address.empty() && address.find_first_not_of("0123456789") == std::string::npos;
+    if (is_port) {
+        // Port 0 would bind to a random port, long strings overflow
+        long port = address.size() <= 5 ? std::strtol(address.c_str(), nullptr, 10) : 0;
+        if (port < 1 || port > 65535) return false;
+        listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_socket < 0) return false;
+        int reuse = 1;
+        setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in name{};
+        name.sin_family = AF_INET;
+        name.sin_port = htons((uint16_t) port);
+        name.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listen_socket, (sockaddr *) &name, sizeof(name)) != 0) {
+            close(listen_socket);
+            listen_socket = -1;
+            return false;
+        }
+    } else {
+        sockaddr_un name{};
+        if (address.size() >= sizeof(name.sun_path)) return false;
+        // Only a socket left by a previous run may be replaced, never an ordinary file
+        struct stat existing{};
+        if (lstat(address.c_str(), &existing) == 0) {
+            if (!S_ISSOCK(existing.st_mode) || unlink(address.c_str()) != 0) return false;
+        } else if (errno != ENOENT) {
+            return false;
+        }
+        listen_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_socket < 0) return false;
+        name.sun_family = AF_UNIX;
+        std::strcpy(name.sun_path, address.c_str());
+        if (bind(listen_socket, (sockaddr *) &name, sizeof(name)) != 0) {
+            close(listen_socket);
+            listen_socket = -1;
+            return false;
+        }
+        socket_path = address;
+    }
+
+    if (listen(listen_socket, 4) != 0) {
+        stop();
+        return false;
+    }
+    running = true;
+    thread = std::thread([this]() { serve_loop(); });
+    return true;
+}
+
+void MetricsServer::stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    if (listen_socket >= 0) {
+        close(listen_socket);
+        listen_socket = -1;
+    }
+    if (!socket_path.empty()) {
+        unlink(socket_path.c_str());
+        socket_path.clear();
+    }
+}
+
+void MetricsServer::serve_loop() {
+    // Wakes up from time to time to check for stop
+    pollfd listen_poll{listen_socket, POLLIN, 0};
+    while (running) {
+        if (poll(&listen_poll, 1, 200) <= 0) continue;
+        int connection = accept(listen_socket, nullptr, nullptr);
+        if (connection < 0) continue;
+        serve(connection);
+        close(connection);
+    }
+}
+
+void MetricsServer::serve(int connection) {
+    // Any request gets the metrics, read it up to the end of the headers
+    std::string request;
+    char buffer[1024];
+    pollfd connection_poll{connection, POLLIN, 0};
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+        if (poll(&connection_poll, 1, 1000) <= 0) return;
+        ssize_t received = read(connection, buffer, sizeof(buffer));
+        if (received <= 0) return;
+        request.append(buffer, received);
+    }
+
+    std::string body = text();
+    std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                           std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t written = send(connection, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return;
+        sent += written;
+    }
+}
+
+#else
+
+MetricsServer::~MetricsServer() = default;
+
+bool MetricsServer::start(const std::string &) {
+    return false; // needs POSIX sockets
+}
+
+void MetricsServer::stop() {}
+
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "model.hpp"
+
+// Serves World stats in Prometheus text format over HTTP on a Unix domain socket or on localhost
+// (POSIX only). The simulation thread publishes the values with relaxed atomic stores in record
+// (see World::metrics), the server thread only loads them - scraping never blocks the simulation.
+// Values of one scrape may come from different steps.
+class MetricsServer {
+public:
+    MetricsServer() = default;
+
+    MetricsServer(const MetricsServer &) = delete;
+
+    ~MetricsServer();
+
+    // address is a port number (127.0.0.1) or a path of a Unix socket
+    bool start(const std::string &address);
+
+    void stop();
+
+    // Called after every World::update, does not allocate or lock
+    void record(const World &world);
+
+    // Current metrics in the exposition format
+    std::string text() const;
+
+private:
+    void serve_loop();
+
+    void serve(int connection);
+
+    static constexpr int k_phases = 7; // see PhaseTimes
+
+    std::atomic<uint64_t> steps{0};
+    std::atomic<double> step_rate{0.0};
+    std::atomic<double> phase_seconds[k_phases] = {};
+    std::atomic<uint64_t> live_particles{0};
+    std::atomic<uint64_t> dead_particles{0};
+    std::atomic<uint64_t> contacts{0};
+    std::atomic<uint64_t> joints{0};
+    std::atomic<uint64_t> volumes{0};
+    std::atomic<int> substeps{0};
+
+    // Owned by the simulation thread, for the step rate
+    uint64_t rate_steps = 0;
+    double rate_seconds = 0.0;
+    std::chrono::steady_clock::time_point rate_start;
+
+    int listen_socket = -1;
+    std::string socket_path; // removed on stop
+    std::atomic<bool> running{false};
+    std::thread thread;
+};
@@ -1,8 +1,14 @@
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
 #include <glm/gtx/norm.hpp>
+#include "metrics.hpp"
 #include "model.hpp"
+#include "prefab.hpp"
+#include "trajectory.hpp"
 
-float get_mass(Particle *p) {
-    return p->radius * p->radius; // mass is proportional to radius squared
+float get_inv_mass(float radius) {
+    return 1.0f / (radius * radius); // mass is proportional to radius squared
 }
 
 float calculate_volume(const std::vector<Particle *> &particles) {
@@ -14,6 +20,14 @@ float calculate_volume(const std::vector<Particle *> &particles) {
     return current_volume;
 }
 
+// Seconds since start, start moves to now
+float lap(std::chrono::steady_clock::time_point &start) {
+    auto now = std::chrono::steady_clock::now();
+    float seconds = std::chrono::duration<float>(now - start).count();
+    start = now;
+    return seconds;
+}
+
 ivec2 pos_to_grid_pos(vec2 pos) {
     return ivec2(floor(pos / World::grid_side)) + World::grid_size / 2;
 }
@@ -22,34 +36,293 @@ bool check_grid_pos(ivec2 grid_pos) {
     return all(greaterThanEqual(grid_pos, ivec2(0))) && all(lessThan(grid_pos, ivec2(World::grid_size)));
 }
 
+uint64_t contact_key(const Particle *p1, const Particle *p2) {
+    // the order of the pair in the solver depends on addresses, the key must not
+    return (uint64_t(min(p1->id, p2->id)) << 32) | max(p1->id, p2->id);
+}
+
+uint64_t contact_key(size_t box_index, const Particle *p) {
+    return (uint64_t(box_index | 0x80000000u) << 32) | p->id; // high bit marks box contacts
+}
+
+struct GridCell {
+    Particle *const *first = nullptr;
+    Particle *const *last = nullptr;
+
+    Particle *const *begin() const { return first; }
+
+    Particle *const *end() const { return last; }
+};
+
+GridCell grid_cell(const World &world, ivec2 grid_pos) {
+    if (world.grid_cells == nullptr) {
+        return {};
+    }
+    int cell = grid_pos.x * World::grid_size + grid_pos.y;
+    return {world.grid_particles + world.grid_cells[cell], world.grid_particles + world.grid_cells[cell + 1]};
+}
+
+// Calls f for alive particles from the grid cells that cover [lo; hi]. The grid is built at the beginning of update,
+// so the range is extended by the largest radius plus one cell for particles that moved since then
+template<typename F>
+void for_each_in_grid(const World &world, vec2 lo, vec2 hi, F &&f) {
+    vec2 margin = vec2(world.max_particle_radius + World::grid_side);
+    ivec2 from = max(pos_to_grid_pos(lo - margin), ivec2(0));
+    ivec2 to = min(pos_to_grid_pos(hi + margin), ivec2(World::grid_size - 1));
+    for (int x = from.x; x <= to.x; x++) {
+        for (int y = from.y; y <= to.y; y++) {
+            for (auto p : grid_cell(world, ivec2(x, y))) {
+                if (p->alive) f(p);
+            }
+        }
+    }
+}
+
+// Distance along the ray (direction is normalized) to the box, ray starting inside is a hit at 0
+std::optional<float> raycast_box(const Box &b, vec2 origin, vec2 direction, float max_distance, vec2 &normal) {
+    vec2 start = rotate2d(origin - b.position, -b.angle);
+    vec2 dir = rotate2d(direction, -b.angle);
+
+    float t_enter = 0.0f, t_exit = max_distance;
+    int axis = -1;
+    for (int i = 0; i < 2; i++) {
+        if (abs(dir[i]) < 0.00001f) {
+            if (abs(start[i]) > b.half_size[i])
+                return std::nullopt;
+            continue;
+        }
+        float t1 = (-b.half_size[i] - start[i]) / dir[i];
+        float t2 = (b.half_size[i] - start[i]) / dir[i];
+        if (t1 > t2) std::swap(t1, t2);
+        if (t1 > t_enter) {
+            t_enter = t1;
+            axis = i;
+        }
+        t_exit = min(t_exit, t2);
+        if (t_enter > t_exit)
+            return std::nullopt;
+    }
+
+    vec2 normal_in_box_space = -dir;
+    if (axis >= 0) {
+        normal_in_box_space = vec2();
+        normal_in_box_space[axis] = dir[axis] > 0.0f ? -1.0f : 1.0f;
+    }
+    normal = rotate2d(normal_in_box_space, b.angle);
+    return t_enter;
+}
+
+// Turns runtime flags into SolverConfig template arguments, one branch per flag
+template<bool... Flags, typename F>
+void dispatch_config(F &&f) {
+    f(SolverConfig<Flags...>());
+}
+
+template<bool... Flags, typename F, typename... Rest>
+void dispatch_config(F &&f, bool flag, Rest... rest) {
+    if (flag) {
+        dispatch_config<Flags..., true>(f, rest...);
+    } else {
+        dispatch_config<Flags..., false>(f, rest...);
+    }
+}
+
 void World::spawn_particle(vec2 position, float radius) {
-    particles.push_back(Particle{radius, position});
+    Particle particle{radius, position};
+    particle.inv_mass = get_inv_mass(radius);
+    particle.id = next_particle_id++;
+    particles.push_back(particle);
+    max_particle_radius = max(max_particle_radius, radius);
 }
 
 void World::spawn_box(vec2 position, vec2 half_size, float angle) {
     boxes.push_back(Box{half_size, position, angle});
 }
 
-void World::spawn_joint(Particle *p1, Particle *p2, float stiffness, float damping) {
-    joints.push_back(Joint{p1, p2, distance(p1->position, p2->position), stiffness, damping});
+size_t World::box_count() const {
+    return boxes.size() + (shared_boxes ? shared_boxes->size() : 0);
+}
+
+const Box &World::box(size_t index) const {
+    return index < boxes.size() ? boxes[index] : (*shared_boxes)[index - boxes.size()];
+}
+
+size_t World::box_index(const Box *b) const {
+    if (b >= boxes.data() && b < boxes.data() + boxes.size()) {
+        return b - boxes.data();
+    }
+    return boxes.size() + (b - shared_boxes->data());
+}
+
+void World::spawn_joint(uint32_t p1, uint32_t p2, float stiffness, float damping) {
+    spawn_joint_with_material(p1, p2, distance(particles[p1].position, particles[p2].position),
+                              joint_material(stiffness, damping));
+}
+
+void World::spawn_joint_with_material(uint32_t p1, uint32_t p2, float length, uint16_t material) {
+    Joint joint{p1, p2};
+    joint.set_length(length);
+    joint.material = material;
+    joints.push_back(joint);
+}
+
+uint16_t World::joint_material(float stiffness, float damping, float clamp) {
+    for (size_t i = 0; i < joint_materials.size(); i++) {
+        auto &m = joint_materials[i];
+        if (m.stiffness == stiffness && m.damping == damping && m.clamp == clamp) {
+            return (uint16_t) i;
+        }
+    }
+    if (joint_materials.size() > UINT16_MAX) {
+        throw std::length_error("World::joint_material: too many joint materials");
+    }
+    joint_materials.push_back(JointMaterial{stiffness, damping, clamp});
+    return (uint16_t) (joint_materials.size() - 1);
+}
+
+void World::spawn_inflated(std::vector<Particle *> particles_, float pressure) {
+    float volume = calculate_volume(particles_);
+    volumes.push_back(InflatedBody{std::move(particles_), volume, pressure});
 }
 
-void World::spawn_inflated(const std::vector<Particle *> &particles_, float pressure) {
-    volumes.push_back(InflatedBody{particles_, calculate_volume(particles_), pressure});
+void World::spawn_prefab(const Prefab &prefab, vec2 position, float angle) {
+    spawn_prefabs(prefab, {PrefabInstance{position, angle}});
+}
+
+void World::spawn_prefabs(const Prefab &prefab, const std::vector<PrefabInstance> &instances) {
+    joints.reserve(joints.size() + prefab.joints.size() * instances.size());
+    std::vector<uint16_t> materials;
+    materials.reserve(prefab.joints.size());
+    for (auto &j : prefab.joints) {
+        materials.push_back(joint_material(j.stiffness, j.damping));
+    }
+    if (prefab.inflated) {
+        volumes.reserve(volumes.size() + instances.size());
+    }
+
+    for (auto &instance : instances) {
+        auto start = (uint32_t) particles.size();
+        float cs = cosf(instance.angle);
+        float sn = sinf(instance.angle);
+
+        auto rotate = [cs, sn](vec2 v) { return vec2(v.x * cs - v.y * sn, v.x * sn + v.y * cs); };
+
+        for (auto &p : prefab.particles) {
+            spawn_particle(rotate(p.position) + instance.position, p.radius);
+            particles.back().velocity = rotate(p.velocity);
+        }
+        for (size_t i = 0; i < prefab.joints.size(); i++) {
+            auto &j = prefab.joints[i];
+            spawn_joint_with_material(start + j.p1, start + j.p2, j.length, materials[i]);
+        }
+        if (prefab.inflated) {
+            InflatedBody body{{}, prefab.volume, prefab.pressure};
+            body.particles.reserve(prefab.particles.size());
+            for (size_t i = start; i < particles.size(); i++) {
+                body.particles.push_back(&particles[i]);
+            }
+            volumes.push_back(std::move(body));
+        }
+    }
+}
+
+void World::remove_dead_particles() {
+    joints.erase(std::remove_if(joints.begin(), joints.end(), [this](const Joint &j) {
+        return !particles[j.p1].alive || !particles[j.p2].alive;
+    }), joints.end());
+    for (auto &v : volumes) {
+        v.particles.erase(std::remove_if(v.particles.begin(), v.particles.end(), [](const Particle *p) {
+            return !p->alive;
+        }), v.particles.end());
+    }
+    volumes.erase(std::remove_if(volumes.begin(), volumes.end(), [](const InflatedBody &v) {
+        return v.particles.size() < 3;
+    }), volumes.end());
+
+    std::vector<uint32_t> new_index(particles.size());
+    std::unordered_map<const Particle *, Particle *> moved; // only volumes keep pointers
+    std::deque<Particle> alive_particles;
+    for (size_t i = 0; i < particles.size(); i++) {
+        if (!particles[i].alive) continue;
+        new_index[i] = (uint32_t) alive_particles.size();
+        alive_particles.push_back(particles[i]);
+        if (!volumes.empty()) {
+            moved[&particles[i]] = &alive_particles.back();
+        }
+    }
+    particles.swap(alive_particles);
+
+    for (auto &j : joints) {
+        j.p1 = new_index[j.p1];
+        j.p2 = new_index[j.p2];
+    }
+    for (auto &v : volumes) {
+        for (auto &p : v.particles) {
+            p = moved[p];
+        }
+    }
+    grid_cells = nullptr;
+    grid_particles = nullptr;
 }
 
 void World::update(float delta_time) {
-    for (auto &row : grid) {
-        for (auto &cell : row) {
-            cell.clear();
+    dispatch_config([&](auto config) { step<decltype(config)>(delta_time); },
+                    box_friction != 0.0f,
+                    box_bounciness != 0.0f || particle_bounciness != 0.0f,
+                    bias_factor != 0.0f,
+                    gravity != vec2(),
+                    warm_starting);
+
+    if (trajectory != nullptr) {
+        trajectory->record(*this);
+    }
+    if (metrics != nullptr) {
+        metrics->record(*this);
+    }
+}
+
+template<typename Config>
+void World::step(float delta_time) {
+    stats.max_velocity = 0.0f;
+    stats.min_radius = 0.0f;
+    stats.max_joint_strain = 0.0f;
+    stats.kinetic_energy = 0.0f;
+    stats.live_particles = 0;
+    stats.contacts = 0;
+    stats.joints = joints.size();
+    stats.volumes = volumes.size();
+    auto phase_start = std::chrono::steady_clock::now();
+
+    if constexpr (Config::warm_starting) {
+        // Enough for a dense pile, so contacts appearing while it settles do not reallocate
+        size_t expected_contacts = particles.size() * 4;
+        if (contacts.capacity() < expected_contacts) {
+            contacts.reserve(expected_contacts);
+            contact_cache.reserve(expected_contacts);
         }
     }
 
-    for (auto &p : particles) {
-        ivec2 grid_pos = pos_to_grid_pos(p.position);
-        if (!check_grid_pos(grid_pos)) continue;
-        grid[grid_pos.x][grid_pos.y].push_back(&p);
+    // Counting sort of the particles by grid cell
+    arena.reset();
+    constexpr int cells_count = grid_size * grid_size;
+    grid_cells = arena.allocate_array<uint32_t>(cells_count + 1);
+    std::fill(grid_cells, grid_cells + cells_count + 1, 0);
+    uint32_t *particle_cells = arena.allocate_array<uint32_t>(particles.size());
+    for (size_t i = 0; i < particles.size(); i++) {
+        ivec2 grid_pos = pos_to_grid_pos(particles[i].position);
+        particle_cells[i] = check_grid_pos(grid_pos) ? grid_pos.x * grid_size + grid_pos.y : UINT32_MAX;
+        if (particle_cells[i] != UINT32_MAX) grid_cells[particle_cells[i] + 1]++;
+    }
+    for (int i = 0; i < cells_count; i++) {
+        grid_cells[i + 1] += grid_cells[i];
+    }
+    grid_particles = arena.allocate_array<Particle *>(grid_cells[cells_count]);
+    uint32_t *cell_fill = arena.allocate_array<uint32_t>(cells_count);
+    std::copy(grid_cells, grid_cells + cells_count, cell_fill);
+    for (size_t i = 0; i < particles.size(); i++) {
+        if (particle_cells[i] != UINT32_MAX) grid_particles[cell_fill[particle_cells[i]]++] = &particles[i];
     }
+    stats.phase_times.grid = lap(phase_start);
 
     for (auto &p : particles) {
         if (!p.alive) continue;
@@ -61,91 +334,275 @@ void World::update(float delta_time) {
             for (int dy = -delta; dy <= delta; dy++) {
                 ivec2 next_grid_pos = grid_pos + ivec2(dx, dy);
                 if (!check_grid_pos(next_grid_pos)) continue;
-                for (auto &p2 : grid[next_grid_pos.x][next_grid_pos.y]) {
+                for (auto p2 : grid_cell(*this, next_grid_pos)) {
                     if (p.radius < p2->radius || p.radius == p2->radius && &p <= p2) {
                         continue;
                     }
-                    solve(&p, p2, delta_time);
+                    solve<Config>(&p, p2, delta_time);
                 }
             }
         }
     }
+    stats.phase_times.particle_collisions = lap(phase_start);
 
     // Particle vs Box
     for (auto &p : particles) {
         if (!p.alive) continue;
-        for (auto &b : boxes) {
-            solve(&b, &p, delta_time);
+        bool fast = continuous_collision && length2(p.velocity) * delta_time * delta_time > p.radius * p.radius;
+        for (size_t i = 0; i < box_count(); i++) {
+            solve<Config>(&box(i), &p, delta_time);
+            if (fast) {
+                solve_swept(&box(i), &p, delta_time);
+            }
         }
     }
+    stats.phase_times.box_collisions = lap(phase_start);
+    if constexpr (Config::warm_starting) {
+        solve_contacts<Config>();
+    }
+    stats.phase_times.contacts = lap(phase_start);
     // Joints
-    for (auto &joint : joints) {
-        solve(&joint, delta_time);
+    if (joint_solver == JointSolver::Xpbd) {
+        for (auto &joint : joints) {
+            solve_xpbd(&joint, delta_time);
+        }
+    } else {
+        for (auto &joint : joints) {
+            solve(&joint, delta_time);
+        }
+    }
+    if (after_joints) {
+        after_joints(delta_time);
     }
+    stats.phase_times.joints = lap(phase_start);
     // Inflated bodies
     for (auto &volume : volumes) {
         solve(&volume, delta_time);
     }
+    stats.phase_times.volumes = lap(phase_start);
     // Integrate
     for (auto &p : particles) {
+        if (p.alive) {
+            float speed_sqr = length2(p.velocity);
+            stats.max_velocity = max(stats.max_velocity, speed_sqr);
+            stats.min_radius = stats.min_radius == 0.0f ? p.radius : min(stats.min_radius, p.radius);
+            stats.kinetic_energy += 0.5f * speed_sqr / p.inv_mass;
+            stats.live_particles++;
+        }
+
         p.position += (p.velocity + p.velocity_pseudo) * delta_time;
-        p.velocity += gravity * delta_time;
-        p.velocity_pseudo = vec3(); // clear pseudo velocity
+        if constexpr (Config::gravity) {
+            p.velocity += gravity * delta_time;
+        }
+        if constexpr (Config::bias) {
+            p.velocity_pseudo = vec3(); // clear pseudo velocity
+        }
 
         if (p.position.y > 8) p.alive = false;
     }
+    stats.max_velocity = sqrtf(stats.max_velocity);
+    stats.dead_particles = particles.size() - stats.live_particles;
+    stats.phase_times.integrate = lap(phase_start);
 }
 
+template<typename Config>
 void World::solve(Particle *p1, Particle *p2, float delta_time) {
     auto collision = find_collision(p1, p2);
 
     if (!collision.has_value())
         return;
+    stats.contacts++;
+
+    if constexpr (Config::bias) {
+        p1->velocity_pseudo -= collision->normal * collision->depth / delta_time * bias_factor;
+        p2->velocity_pseudo += collision->normal * collision->depth / delta_time * bias_factor;
+    }
 
-    p1->velocity_pseudo -= collision->normal * collision->depth / delta_time * bias_factor;
-    p2->velocity_pseudo += collision->normal * collision->depth / delta_time * bias_factor;
+    if constexpr (Config::warm_starting) {
+        contacts.push_back(Contact{contact_key(p1, p2), p1, p2, collision->normal});
+        return;
+    }
 
     float velocity_projected = dot(collision->normal, p1->velocity - p2->velocity);
-    float effective_mass = (1.0f / (1.0f / get_mass(p1) + 1.0f / get_mass(p2)));
-    float impulse = (1.0f + particle_bounciness) * velocity_projected * effective_mass;
+    float effective_mass = 1.0f / (p1->inv_mass + p2->inv_mass);
+    float impulse = velocity_projected * effective_mass;
+    if constexpr (Config::bounciness) {
+        impulse *= 1.0f + particle_bounciness;
+    }
 
     if (impulse < 0.0f)
         return;
 
-    p1->velocity -= impulse * collision->normal / get_mass(p1);
-    p2->velocity += impulse * collision->normal / get_mass(p2);
+    p1->velocity -= impulse * collision->normal * p1->inv_mass;
+    p2->velocity += impulse * collision->normal * p2->inv_mass;
 }
 
-void World::solve(Box *b, Particle *p, float delta_time) {
+template<typename Config>
+void World::solve(const Box *b, Particle *p, float delta_time) {
     auto collision = find_collision(b, p);
 
     if (!collision.has_value())
         return;
+    stats.contacts++;
+
+    if constexpr (Config::bias) {
+        p->velocity_pseudo += collision->normal * collision->depth / delta_time * bias_factor;
+    }
 
-    p->velocity_pseudo += collision->normal * collision->depth / delta_time * bias_factor;
+    if constexpr (Config::warm_starting) {
+        contacts.push_back(Contact{contact_key(box_index(b), p), p, nullptr, collision->normal});
+        return;
+    }
 
     if (dot(p->velocity, collision->normal) > 0.0f)
         return;
 
-    vec2 tangent = tangent2d(collision->normal);
+    if constexpr (Config::bounciness) {
+        p->velocity -= (1.0f + box_bounciness) * dot(p->velocity, collision->normal) * collision->normal;
+    } else {
+        p->velocity -= dot(p->velocity, collision->normal) * collision->normal;
+    }
+    if constexpr (Config::friction) {
+        vec2 tangent = tangent2d(collision->normal);
+        p->velocity -= box_friction * dot(p->velocity, tangent) * tangent;
+    }
+}
+
+void World::solve_swept(const Box *b, Particle *p, float delta_time) {
+    auto collision = find_collision_swept(b, p, delta_time);
+
+    if (!collision.has_value())
+        return;
 
-    p->velocity -= (1.0f + box_bounciness) * dot(p->velocity, collision->normal) * collision->normal;
-    p->velocity -= box_friction * dot(p->velocity, tangent) * tangent;
+    // Speculative contact: remove only the part of the velocity that would take the particle through the box
+    float velocity_projected = dot(p->velocity, collision->normal);
+    float allowed_velocity = -collision->depth / delta_time;
+    if (velocity_projected < -allowed_velocity) {
+        p->velocity -= (velocity_projected + allowed_velocity) * collision->normal;
+    }
+}
+
+template<typename Config>
+void World::solve_contacts() {
+    // Warm start: contacts that existed in the previous step begin with its accumulated impulses
+    std::sort(contacts.begin(), contacts.end(), [](const Contact &a, const Contact &b) { return a.key < b.key; });
+    auto cached = contact_cache.begin();
+    for (auto &c : contacts) {
+        while (cached != contact_cache.end() && cached->key < c.key) cached++;
+        if (cached == contact_cache.end() || cached->key != c.key) continue;
+
+        c.normal_impulse = cached->normal_impulse;
+        c.tangent_impulse = cached->tangent_impulse;
+        if (c.p2 != nullptr) {
+            c.p1->velocity -= c.normal_impulse * c.normal * c.p1->inv_mass;
+            c.p2->velocity += c.normal_impulse * c.normal * c.p2->inv_mass;
+        } else {
+            vec2 impulse = c.normal_impulse * c.normal + c.tangent_impulse * tangent2d(c.normal);
+            c.p1->velocity += impulse * c.p1->inv_mass;
+        }
+    }
+
+    // Solve, clamping the accumulated (not the incremental) impulse
+    for (auto &c : contacts) {
+        if (c.p2 != nullptr) {
+            float velocity_projected = dot(c.normal, c.p1->velocity - c.p2->velocity);
+            float impulse = velocity_projected / (c.p1->inv_mass + c.p2->inv_mass);
+            if constexpr (Config::bounciness) {
+                impulse *= 1.0f + particle_bounciness;
+            }
+            float accumulated = max(c.normal_impulse + impulse, 0.0f);
+            impulse = accumulated - c.normal_impulse;
+            c.normal_impulse = accumulated;
+
+            c.p1->velocity -= impulse * c.normal * c.p1->inv_mass;
+            c.p2->velocity += impulse * c.normal * c.p2->inv_mass;
+        } else {
+            auto p = c.p1;
+            float impulse = -dot(p->velocity, c.normal) / p->inv_mass;
+            if constexpr (Config::bounciness) {
+                impulse *= 1.0f + box_bounciness;
+            }
+            float accumulated = max(c.normal_impulse + impulse, 0.0f);
+            impulse = accumulated - c.normal_impulse;
+            c.normal_impulse = accumulated;
+            p->velocity += impulse * c.normal * p->inv_mass;
+
+            if constexpr (Config::friction) {
+                // Coulomb friction, tangent impulse is limited by the normal one
+                vec2 tangent = tangent2d(c.normal);
+                float tangent_impulse = -dot(p->velocity, tangent) / p->inv_mass;
+                float max_friction = box_friction * c.normal_impulse;
+                float tangent_accumulated = clamp(c.tangent_impulse + tangent_impulse, -max_friction, max_friction);
+                tangent_impulse = tangent_accumulated - c.tangent_impulse;
+                c.tangent_impulse = tangent_accumulated;
+                p->velocity += tangent_impulse * tangent * p->inv_mass;
+            }
+        }
+    }
+
+    // Contacts are already sorted by key - the cache for the next step is built in the same order
+    contact_cache.resize(contacts.size());
+    for (size_t i = 0; i < contacts.size(); i++) {
+        contact_cache[i] = CachedImpulse{contacts[i].key, contacts[i].normal_impulse, contacts[i].tangent_impulse};
+    }
+    contacts.clear();
 }
 
 void World::solve(Joint *joint, float delta_time) {
-    auto p1 = joint->p1, p2 = joint->p2;
+    auto p1 = &particles[joint->p1], p2 = &particles[joint->p2];
+    const JointMaterial &material = joint_materials[joint->material];
+    float rest_length = joint->length();
 
     float current_length = length(p1->position - p2->position);
     vec2 direction = normalize(p2->position - p1->position);
 
-    float length_difference = clamp(joint->length - current_length, -0.8f, 0.8f);
-    float velocity_projection = clamp(dot(direction, p1->velocity - p2->velocity), -0.8f, 0.8f);
+    stats.max_joint_strain = max(stats.max_joint_strain, abs(rest_length - current_length) / rest_length);
+
+    float length_difference = clamp(rest_length - current_length, -material.clamp, material.clamp);
+    float velocity_projection = clamp(dot(direction, p1->velocity - p2->velocity), -material.clamp, material.clamp);
+
+    float force = length_difference * material.stiffness + velocity_projection * material.damping;
+
+    p1->velocity -= force * delta_time * direction * p1->inv_mass;
+    p2->velocity += force * delta_time * direction * p2->inv_mass;
+}
+
+void World::solve_xpbd(Joint *joint, float delta_time) {
+    auto p1 = &particles[joint->p1], p2 = &particles[joint->p2];
+    const JointMaterial &material = joint_materials[joint->material];
+    float rest_length = joint->length();
+
+    float inv_mass_sum = p1->inv_mass + p2->inv_mass;
+    if (material.stiffness <= 0.0f || inv_mass_sum == 0.0f)
+        return;
+
+    vec2 delta = p2->position - p1->position;
+    if (length(delta) < 0.00001f)
+        return;
+
+    // Damping is the same impulse as in the force solver, limited so it can't reverse the relative velocity.
+    // It is kept out of the compliance term - there it would make the joint softer at small time steps.
+    vec2 direction = normalize(delta);
+    float relative_velocity = dot(direction, p2->velocity - p1->velocity);
+    float damping = min(material.damping * delta_time * inv_mass_sum, 1.0f) * relative_velocity / inv_mass_sum;
+    p1->velocity += damping * direction * p1->inv_mass;
+    p2->velocity -= damping * direction * p2->inv_mass;
+
+    // Constraint is evaluated at the positions predicted for the end of the step,
+    // the position correction is then applied as a velocity change
+    delta += (p2->velocity - p1->velocity) * delta_time;
+    float current_length = length(delta);
+    if (current_length < 0.00001f)
+        return;
+    direction = delta / current_length;
 
-    float force = length_difference * joint->stiffness + velocity_projection * joint->damping;
+    float constraint = current_length - rest_length;
+    stats.max_joint_strain = max(stats.max_joint_strain, abs(constraint) / rest_length);
+    float compliance = 1.0f / (material.stiffness * delta_time * delta_time); // stiffness = 1 / compliance
+    float lambda = -constraint / (inv_mass_sum + compliance);
 
-    p1->velocity -= force * delta_time * direction / get_mass(p1);
-    p2->velocity += force * delta_time * direction / get_mass(p2);
+    p1->velocity -= lambda * direction * p1->inv_mass / delta_time;
+    p2->velocity += lambda * direction * p2->inv_mass / delta_time;
 }
 
 void World::solve(InflatedBody *v, float delta_time) {
@@ -167,11 +624,122 @@ void World::solve(InflatedBody *v, float delta_time) {
         float current_length = length(p1->position - p2->position);
         float force = current_length * pressure_difference - velocity_projected * 0.005f;
 
-        p1->velocity += force * delta_time * normal / get_mass(p1);
-        p2->velocity += force * delta_time * normal / get_mass(p2);
+        p1->velocity += force * delta_time * normal * p1->inv_mass;
+        p2->velocity += force * delta_time * normal * p2->inv_mass;
     }
 }
 
+void World::query_aabb(vec2 min, vec2 max, std::vector<Particle *> &result) const {
+    result.clear();
+    for_each_in_grid(*this, min, max, [&](Particle *p) {
+        vec2 nearest = clamp(p->position, min, max);
+        if (distance2(nearest, p->position) <= p->radius * p->radius) {
+            result.push_back(p);
+        }
+    });
+}
+
+void World::query_radius(vec2 center, float radius, std::vector<Particle *> &result) const {
+    result.clear();
+    for_each_in_grid(*this, center - radius, center + radius, [&](Particle *p) {
+        float radius_sum = radius + p->radius;
+        if (distance2(center, p->position) <= radius_sum * radius_sum) {
+            result.push_back(p);
+        }
+    });
+}
+
+void World::query_nearest(vec2 point, size_t k, std::vector<Particle *> &result) const {
+    result.clear();
+    if (k == 0)
+        return;
+
+    auto closer = [point](Particle *a, Particle *b) {
+        return distance2(point, a->position) < distance2(point, b->position);
+    };
+
+    // Grow the search area until it contains k particles that are closer than its half size,
+    // starting from the size that reaches the grid when the point is outside of it
+    const vec2 grid_bound = vec2(grid_side * grid_size / 2);
+    vec2 outside = max(abs(point) - grid_bound, vec2(0.0f));
+    for (float half_size = max(grid_side, max(outside.x, outside.y)); ; half_size *= 2.0f) {
+        result.clear();
+        for_each_in_grid(*this, point - half_size, point + half_size, [&](Particle *p) { result.push_back(p); });
+
+        vec2 lo = point - half_size, hi = point + half_size;
+        bool covers_grid = lo.x <= -grid_bound.x && lo.y <= -grid_bound.y && hi.x >= grid_bound.x && hi.y >= grid_bound.y;
+        if (result.size() >= k) {
+            std::partial_sort(result.begin(), result.begin() + k, result.end(), closer);
+            if (distance(point, result[k - 1]->position) <= half_size || covers_grid) {
+                result.resize(k);
+                return;
+            }
+        } else if (covers_grid) {
+            std::sort(result.begin(), result.end(), closer);
+            return;
+        }
+    }
+}
+
+std::optional<RaycastHit> World::raycast(vec2 origin, vec2 direction, float max_distance) const {
+    direction = normalize(direction);
+    std::optional<RaycastHit> hit;
+    float best = max_distance;
+
+    // Boxes - there are only a few of them
+    for (size_t i = 0; i < box_count(); i++) {
+        vec2 normal;
+        auto t = raycast_box(box(i), origin, direction, best, normal);
+        if (t.has_value() && *t <= best) {
+            best = *t;
+            hit = RaycastHit{nullptr, &box(i), origin + direction * best, normal, best};
+        }
+    }
+
+    // Particles are only in the grid - clip the ray to its bounds, widened by the largest radius
+    float enter = 0.0f, leave = best;
+    const float grid_bound = grid_side * grid_size / 2 + max_particle_radius;
+    for (int axis = 0; axis < 2; axis++) {
+        if (direction[axis] == 0.0f) {
+            if (abs(origin[axis]) > grid_bound) return hit;
+            continue;
+        }
+        float t1 = (-grid_bound - origin[axis]) / direction[axis];
+        float t2 = (grid_bound - origin[axis]) / direction[axis];
+        enter = max(enter, min(t1, t2));
+        leave = min(leave, max(t1, t2));
+    }
+
+    // Walk along the ray by segments of a few cells, a hit inside a segment can't be beaten
+    // by particles from the next ones. The start is counted from the segment index, adding to a large float
+    // could leave it unchanged.
+    const float segment_length = grid_side * 4.0f;
+    for (int segment = 0; ; segment++) {
+        float segment_start = enter + segment * segment_length;
+        if (segment_start >= min(best, leave)) break;
+        vec2 a = origin + direction * segment_start;
+        vec2 b = origin + direction * min(segment_start + segment_length, min(best, leave));
+        for_each_in_grid(*this, min(a, b), max(a, b), [&](Particle *p) {
+            vec2 to_center = p->position - origin;
+            float projection = dot(to_center, direction);
+            float dist_sqr = length2(to_center) - projection * projection;
+            if (dist_sqr > p->radius * p->radius)
+                return;
+            float t = max(projection - sqrtf(p->radius * p->radius - dist_sqr), 0.0f);
+            if (t > best || (projection < 0.0f && length2(to_center) > p->radius * p->radius))
+                return;
+            best = t;
+            vec2 point = origin + direction * t;
+            vec2 normal = t > 0.0f ? normalize(point - p->position) : -direction;
+            hit = RaycastHit{p, nullptr, point, normal, t};
+        });
+        if (hit.has_value() && best <= segment_start + segment_length)
+            break;
+    }
+
+    return hit;
+}
+
 std::optional<Collision> World::find_collision(Particle *p1, Particle *p2) {
     float dist_sqr = distance2(p1->position, p2->position);
     float sum_radius = p1->radius + p2->radius;
@@ -188,7 +756,7 @@ std::optional<Collision> World::find_collision(Particle *p1, Particle *p2) {
     return collision;
 }
 
-std::optional<Collision> World::find_collision(Box *b, Particle *p) {
+std::optional<Collision> World::find_collision(const Box *b, Particle *p) {
     float dist_sqr = distance2(b->position, p->position);
     float radius_sum = length(b->half_size) + p->radius;
 
@@ -203,6 +771,18 @@ std::optional<Collision> World::find_collision(Box *b, Particle *p) {
     if (dist > p->radius)
         return std::nullopt;
 
+    if (dist < 0.00001f) {
+        // particle center is inside the box (large time steps) - push it out through the nearest side
+        vec2 gap = b->half_size - abs(particle_in_box_space);
+        vec2 normal_in_box_space = gap.x < gap.y
+                                   ? vec2(particle_in_box_space.x < 0.0f ? -1.0f : 1.0f, 0.0f)
+                                   : vec2(0.0f, particle_in_box_space.y < 0.0f ? -1.0f : 1.0f);
+        Collision collision;
+        collision.depth = p->radius + min(gap.x, gap.y);
+        collision.normal = rotate2d(normal_in_box_space, b->angle);
+        return collision;
+    }
+
     vec2 nearest = rotate2d(nearest_in_box_space, b->angle) + b->position;
 
     Collision collision;
@@ -210,3 +790,50 @@ std::optional<Collision> World::find_collision(Box *b, Particle *p) {
     collision.normal = (p->position - nearest) / dist;
     return collision;
 }
+
+std::optional<Collision> World::find_collision_swept(const Box *b, Particle *p, float delta_time) {
+    vec2 motion = p->velocity * delta_time;
+
+    // fast check - distance from the box center to the path of the particle
+    float radius_sum = length(b->half_size) + p->radius;
+    float t = clamp(dot(b->position - p->position, motion) / max(length2(motion), 0.00001f), 0.0f, 1.0f);
+    if (distance2(b->position, p->position + motion * t) > radius_sum * radius_sum)
+        return std::nullopt;
+
+    // Ray vs box inflated by the radius (corners are not rounded, it is a bit conservative there)
+    vec2 start = rotate2d(p->position - b->position, -b->angle);
+    vec2 direction = rotate2d(motion, -b->angle);
+    vec2 extent = b->half_size + p->radius;
+
+    float t_enter = 0.0f, t_exit = 1.0f;
+    int axis = -1;
+    for (int i = 0; i < 2; i++) {
+        if (abs(direction[i]) < 0.00001f) {
+            if (abs(start[i]) > extent[i])
+                return std::nullopt;
+            continue;
+        }
+        float t1 = (-extent[i] - start[i]) / direction[i];
+        float t2 = (extent[i] - start[i]) / direction[i];
+        if (t1 > t2) std::swap(t1, t2);
+        if (t1 > t_enter) {
+            t_enter = t1;
+            axis = i;
+        }
+        t_exit = min(t_exit, t2);
+        if (t_enter > t_exit)
+            return std::nullopt;
+    }
+
+    // Already overlapping at the start of the step - find_collision handles it
+    if (axis < 0)
+        return std::nullopt;
+
+    vec2 normal_in_box_space = vec2();
+    normal_in_box_space[axis] = direction[axis] > 0.0f ? -1.0f : 1.0f;
+
+    Collision collision;
+    collision.depth = -t_enter * abs(direction[axis]);
+    collision.normal = rotate2d(normal_in_box_space, b->angle);
+    return collision;
+}
@@ -1,11 +1,23 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <optional>
 #include <vector>
 #include <deque>
+#include <functional>
+#include <memory>
 #include <set>
+#include <unordered_map>
 
+#include "arena.hpp"
 #include "geometry.hpp"
+#include "thread_pool.hpp"
+
+class TrajectoryWriter;
+class MetricsServer;
+struct Prefab;
+struct PrefabInstance;
 
 struct Particle {
     float radius = 0.1f;
@@ -13,6 +25,8 @@ struct Particle {
     vec2 velocity = vec2();
     vec2 velocity_pseudo = vec2();
     bool alive = true;
+    float inv_mass = 100.0f; // 1 / mass, mass is proportional to radius squared
+    uint32_t id = 0; // unique within the world, used as a contact handle
 };
 
 struct Box {
@@ -26,12 +40,61 @@ struct Collision {
     float depth = 0.0f;
 };
 
-struct Joint {
+// Contact collected by the narrow phase when warm starting is enabled
+struct Contact {
+    uint64_t key = 0; // particle pair or box/particle pair, see contact_key
     Particle *p1 = nullptr;
-    Particle *p2 = nullptr;
-    float length = 0.0f;
+    Particle *p2 = nullptr; // nullptr for particle vs box contacts
+    vec2 normal = vec2();
+    float normal_impulse = 0.0f; // accumulated over the steps
+    float tangent_impulse = 0.0f;
+};
+
+struct CachedImpulse {
+    uint64_t key = 0;
+    float normal_impulse = 0.0f;
+    float tangent_impulse = 0.0f;
+};
+
+// Parameters shared by many joints, see World::joint_material
+struct JointMaterial {
     float stiffness = 0.0f;
     float damping = 0.0f;
+    float clamp = 0.8f; // limit of length difference and velocity projection in the force solver
+};
+
+// 12-16 bytes, so many joints fit in cache during the joint solve.
+// With LIT_HALF_JOINT_LENGTH the rest length is stored in half precision.
+struct Joint {
+    uint32_t p1 = 0; // indices in World::particles
+    uint32_t p2 = 0;
+#ifdef LIT_HALF_JOINT_LENGTH
+    uint16_t packed_length = 0;
+#else
+    float packed_length = 0.0f;
+#endif
+    uint16_t material = 0; // index in World::joint_materials
+
+    float length() const {
+#ifdef LIT_HALF_JOINT_LENGTH
+        return unpackHalf1x16(packed_length);
+#else
+        return packed_length;
+#endif
+    }
+
+    void set_length(float length) {
+#ifdef LIT_HALF_JOINT_LENGTH
+        packed_length = packHalf1x16(length);
+#else
+        packed_length = length;
+#endif
+    }
+};
+
+enum class JointSolver {
+    Force, // spring force, stiff joints are stable only with small time steps
+    Xpbd   // compliance based position constraint (XPBD), stable with frame-sized time steps
 };
 
 struct InflatedBody {
@@ -40,6 +103,51 @@ struct InflatedBody {
     float pressure = 1.0f;
 };
 
+struct RaycastHit {
+    Particle *particle = nullptr; // one of them is set
+    const Box *box = nullptr;
+    vec2 point = vec2();
+    vec2 normal = vec2();
+    float distance = 0.0f;
+};
+
+// Duration of the phases of the last step, seconds
+struct PhaseTimes {
+    float grid = 0.0f;
+    float particle_collisions = 0.0f;
+    float box_collisions = 0.0f;
+    float contacts = 0.0f; // warm-started contact solve
+    float joints = 0.0f;
+    float volumes = 0.0f;
+    float integrate = 0.0f;
+};
+
+// Filled by World::update, describes the last step
+struct WorldStats {
+    int substeps = 0; // sub-steps of the last frame, set by StepController
+    float max_velocity = 0.0f;
+    float min_radius = 0.0f;
+    float max_joint_strain = 0.0f; // |length - rest length| / rest length
+    float kinetic_energy = 0.0f;
+    size_t live_particles = 0;
+    size_t dead_particles = 0; // not removed yet, see World::remove_dead_particles
+    size_t contacts = 0; // particle and box contacts found by the narrow phase
+    size_t joints = 0;
+    size_t volumes = 0;
+    PhaseTimes phase_times;
+};
+
+// Compile-time solver configuration. World::update picks one specialization per step,
+// so the terms that are disabled in the world (zero friction, bounciness etc.) are not evaluated at all
+template<bool Friction, bool Bounciness, bool Bias, bool Gravity, bool WarmStarting>
+struct SolverConfig {
+    static constexpr bool friction = Friction;
+    static constexpr bool bounciness = Bounciness;
+    static constexpr bool bias = Bias;
+    static constexpr bool gravity = Gravity;
+    static constexpr bool warm_starting = WarmStarting;
+};
+
 struct World {
 
     void update(float delta_time);
@@ -49,30 +157,75 @@ struct World {
 
     void spawn_box(vec2 position, vec2 half_size, float angle = 0.0f);
 
-    void spawn_joint(Particle *p1, Particle *p2, float stiffness, float damping);
+    void spawn_joint(uint32_t p1, uint32_t p2, float stiffness, float damping);
 
-    void spawn_inflated(const std::vector<Particle *> &particles, float pressure);
+    // Joint with a given rest length and an index in joint_materials
+    void spawn_joint_with_material(uint32_t p1, uint32_t p2, float length, uint16_t material);
 
-    // Solve methods
-    void solve(Particle *p1, Particle *p2, float delta_time);
+    // Index of the material with these parameters, added to the table if there is no such one yet.
+    // Throws std::length_error when the table already holds 65536 materials.
+    uint16_t joint_material(float stiffness, float damping, float clamp = 0.8f);
+
+    void spawn_inflated(std::vector<Particle *> particles, float pressure);
+
+    void spawn_prefab(const Prefab &prefab, vec2 position, float angle = 0.0f);
 
-    void solve(Box *b, Particle *p, float delta_time);
+    // Reserves space for all instances at once
+    void spawn_prefabs(const Prefab &prefab, const std::vector<PrefabInstance> &instances);
+
+    // Removes particles that are not alive together with their joints, indices and pointers to the rest are updated
+    void remove_dead_particles();
+
+    // Solve methods
+    void solve_swept(const Box *b, Particle *p, float delta_time);
 
     void solve(Joint *joint, float delta_time);
 
+    void solve_xpbd(Joint *joint, float delta_time);
+
     void solve(InflatedBody *volume, float delta_time);
 
+    // Spatial queries over alive particles (and boxes for raycast). They reuse the grid built by the last update,
+    // so particles outside of the grid are not found. Queries only read the world - they can run in parallel.
+    void query_aabb(vec2 min, vec2 max, std::vector<Particle *> &result) const;
+
+    void query_radius(vec2 center, float radius, std::vector<Particle *> &result) const;
+
+    void query_nearest(vec2 point, size_t k, std::vector<Particle *> &result) const;
+
+    std::optional<RaycastHit> raycast(vec2 origin, vec2 direction, float max_distance) const;
+
+    // Runs query(i, worker) for every i in [0, count) on the pool. worker < pool.size() is never used by two
+    // calls at once, so per-worker result buffers can be kept between batches. The queries read the live world,
+    // there is no copy - it must not change until query_batch returns.
+    // Waits for all tasks of the pool, not only for the queries.
+    template<typename F>
+    void query_batch(ThreadPool &pool, size_t count, F &&query) const;
+
+    // Own boxes followed by the shared ones
+    size_t box_count() const;
+
+    const Box &box(size_t index) const;
+
+    size_t box_index(const Box *b) const;
+
     // Find collision methods
     static std::optional<Collision> find_collision(Particle *p1, Particle *p2);
 
-    static std::optional<Collision> find_collision(Box *b, Particle *p);
+    static std::optional<Collision> find_collision(const Box *b, Particle *p);
+
+    // Time of impact test for a particle moving with its velocity during the step.
+    // Depth is negative - it is the gap to the box that the particle can still travel.
+    static std::optional<Collision> find_collision_swept(const Box *b, Particle *p, float delta_time);
 
     // Members
     std::deque<Particle> particles; // deque - to keep pointers valid even after push_back
     std::vector<Box> boxes;
+    std::shared_ptr<const std::vector<Box>> shared_boxes; // read-only level geometry, can be shared by many worlds
 
     std::vector<InflatedBody> volumes;
     std::vector<Joint> joints;
+    std::vector<JointMaterial> joint_materials;
 
     vec2 gravity = vec2(0, 2.0);
 
@@ -82,11 +235,70 @@ struct World {
     float box_bounciness = 0.0f;
     float particle_bounciness = 0.0f;
 
-    // Simple data structure to speed up O(N^2) search of particle-particle collisions
+    JointSolver joint_solver = JointSolver::Force;
+
+    // Swept particle vs box test for particles that move further than their radius in one step
+    bool continuous_collision = false;
+
+    // Accumulate contact impulses and start each step from the impulses of the previous one
+    bool warm_starting = false;
+    std::vector<Contact> contacts;
+    std::vector<CachedImpulse> contact_cache; // sorted by key
+    uint32_t next_particle_id = 0;
+
+    // Temporary data of one step, reset at its beginning - the grid stays valid until the next update
+    FrameArena arena;
+
+    // Simple data structure to speed up O(N^2) search of particle-particle collisions.
+    // Particles are sorted by cell: cell (x, y) is grid_particles[grid_cells[c]] .. grid_particles[grid_cells[c + 1]]
+    // where c = x * grid_size + y. Both arrays are in the arena, nullptr when there is no grid.
     static constexpr int grid_size = 140;
     static constexpr float grid_side = 0.2f;
-    std::vector<Particle*> grid[grid_size][grid_size];
+    uint32_t *grid_cells = nullptr;
+    Particle **grid_particles = nullptr;
+    float max_particle_radius = 0.0f;
 
     // How much pseudo velocity we will apply when bodies intersect [0; 1]
     float bias_factor = 0.2f;
+
+    WorldStats stats;
+
+    // Receives the state after every update, not owned
+    TrajectoryWriter *trajectory = nullptr;
+
+    // Receives the stats after every update, not owned
+    MetricsServer *metrics = nullptr;
+
+    // Called in every step right after the joints, for constraints that live outside of the world
+    std::function<void(float delta_time)> after_joints;
+
+private:
+    // Defined in model.cpp and instantiated there by update for every SolverConfig
+    template<typename Config>
+    void step(float delta_time);
+
+    template<typename Config>
+    void solve(Particle *p1, Particle *p2, float delta_time);
+
+    template<typename Config>
+    void solve(const Box *b, Particle *p, float delta_time);
+
+    template<typename Config>
+    void solve_contacts();
 };
+
+template<typename F>
+void World::query_batch(ThreadPool &pool, size_t count, F &&query) const {
+    size_t workers_count = std::min(pool.size(), count);
+    if (workers_count <= 1) {
+        for (size_t i = 0; i < count; i++) query(i, size_t(0));
+        return;
+    }
+    // One contiguous range per worker index
+    for (size_t w = 0; w < workers_count; w++) {
+        pool.submit([&, w]() {
+            for (size_t i = count * w / workers_count; i < count * (w + 1) / workers_count; i++) query(i, w);
+        });
+    }
+    pool.wait();
+}
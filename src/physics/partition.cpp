@@ -0,0 +1,527 @@
+#include "partition.hpp"
+
+#ifdef __unix__
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <limits>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+    bool write_all(int fd, const void *data, size_t size) {
+        auto bytes = static_cast<const char *>(data);
+        while (size > 0) {
+            ssize_t written = send(fd, bytes, size, MSG_NOSIGNAL);
+            if (written <= 0) return false;
+            bytes += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    bool read_all(int fd, void *data, size_t size) {
+        auto bytes = static_cast<char *>(data);
+        while (size > 0) {
+            ssize_t received = read(fd, bytes, size);
+            if (received <= 0) return false;
+            bytes += received;
+            size -= received;
+        }
+        return true;
+    }
+
+    template<typename T>
+    bool send_vector(int fd, const std::vector<T> &values) {
+        uint64_t count = values.size();
+        return write_all(fd, &count, sizeof(count)) && write_all(fd, values.data(), count * sizeof(T));
+    }
+
+    template<typename T>
+    bool receive_vector(int fd, std::vector<T> &values) {
+        uint64_t count = 0;
+        if (!read_all(fd, &count, sizeof(count))) return false;
+        values.resize(count);
+        return read_all(fd, values.data(), count * sizeof(T));
+    }
+
+    // Sends and receives at the same time (fd is non-blocking),
+    // so two neighbours can't get stuck writing to each other's full socket buffers
+    template<typename T>
+    bool exchange(int fd, const std::vector<T> &out, std::vector<T> &in) {
+        in.clear();
+        if (fd < 0) return true;
+
+        uint64_t out_count = out.size();
+        uint64_t in_count = 0;
+        size_t out_total = sizeof(out_count) + out_count * sizeof(T);
+        size_t in_total = sizeof(in_count);
+        size_t out_done = 0, in_done = 0;
+
+        while (out_done < out_total || in_done < in_total) {
+            pollfd descriptor{fd, short((out_done < out_total ? POLLOUT : 0) | (in_done < in_total ? POLLIN : 0)), 0};
+            if (poll(&descriptor, 1, -1) < 0) return false;
+            if (descriptor.revents & (POLLERR | POLLNVAL)) return false;
+
+            if (out_done < out_total && (descriptor.revents & POLLOUT)) {
+                const char *bytes = out_done < sizeof(out_count)
+                                    ? reinterpret_cast<const char *>(&out_count) + out_done
+                                    : reinterpret_cast<const char *>(out.data()) + (out_done - sizeof(out_count));
+                size_t size = out_done < sizeof(out_count) ? sizeof(out_count) - out_done : out_total - out_done;
+                ssize_t written = send(fd, bytes, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (written < 0 && errno != EAGAIN) return false;
+                if (written > 0) out_done += written;
+            }
+
+            if (in_done < in_total && (descriptor.revents & (POLLIN | POLLHUP))) {
+                char *bytes = in_done < sizeof(in_count)
+                              ? reinterpret_cast<char *>(&in_count) + in_done
+                              : reinterpret_cast<char *>(in.data()) + (in_done - sizeof(in_count));
+                size_t size = in_done < sizeof(in_count) ? sizeof(in_count) - in_done : in_total - in_done;
+                ssize_t received = recv(fd, bytes, size, MSG_DONTWAIT);
+                if (received == 0 || (received < 0 && errno != EAGAIN)) return false;
+                if (received > 0) in_done += received;
+                if (in_done == sizeof(in_count) && in_total == sizeof(in_count)) {
+                    in.resize(in_count);
+                    in_total += in_count * sizeof(T);
+                }
+            }
+        }
+        return true;
+    }
+
+    struct RemoteJoint {
+        uint32_t local_id = 0;
+        uint32_t remote_id = 0;
+        float length = 0.0f;
+        uint16_t material = 0;
+    };
+
+    // Velocity of a particle or its change
+    struct VelocityFeedback {
+        uint32_t id = 0;
+        vec2 velocity = vec2();
+    };
+
+    // Runs in the worker process and owns particles with lo <= x < hi
+    struct Worker {
+        void init(const World &source) {
+            world.gravity = source.gravity;
+            world.box_friction = source.box_friction;
+            world.box_bounciness = source.box_bounciness;
+            world.particle_bounciness = source.particle_bounciness;
+            world.joint_solver = source.joint_solver;
+            world.warm_starting = source.warm_starting;
+            world.continuous_collision = source.continuous_collision;
+            world.bias_factor = source.bias_factor;
+            world.after_joints = [this](float delta_time) {
+                exchange_failed = exchange_failed || !solve_remote_joints(delta_time);
+            };
+            world.boxes = source.boxes;
+            world.shared_boxes = source.shared_boxes;
+
+            for (auto &p : source.particles) {
+                if (p.alive && owns(p.position.x)) {
+                    spawn(ParticleState{p.id, p.radius, p.position, p.velocity});
+                }
+            }
+            index_particles();
+            for (auto &j : source.joints) {
+                if (owns(source.particles[j.p1].position.x)) {
+                    add_joint(joint_state(source, j));
+                }
+            }
+        }
+
+        void run() {
+            while (true) {
+                char command = 0;
+                if (!read_all(control, &command, 1)) break;
+                if (command == 'U') {
+                    float delta_time = 0.0f;
+                    if (!read_all(control, &delta_time, sizeof(delta_time))) break;
+                    if (!update(delta_time)) break;
+                    if (!write_all(control, &command, 1)) break;
+                } else if (command == 'G') {
+                    std::vector<ParticleState> states;
+                    for (auto &p : world.particles) {
+                        if (p.alive) states.push_back(ParticleState{p.id, p.radius, p.position, p.velocity});
+                    }
+                    if (!send_vector(control, states)) break;
+                } else {
+                    break;
+                }
+            }
+        }
+
+        bool owns(float x) const {
+            return x >= lo && x < hi;
+        }
+
+        void spawn(const ParticleState &state) {
+            world.spawn_particle(state.position, state.radius);
+            world.particles.back().id = state.id;
+            world.particles.back().velocity = state.velocity;
+        }
+
+        // Local particles, only after they were removed, moved or received
+        void index_particles() {
+            by_id.clear();
+            for (size_t i = 0; i < world.particles.size(); i++) {
+                by_id[world.particles[i].id] = (uint32_t) i;
+            }
+        }
+
+        // Ghosts are a thin layer along the borders, they are indexed every step
+        void index_ghosts() {
+            ghost_by_id.clear();
+            for (size_t i = local_count; i < world.particles.size(); i++) {
+                ghost_by_id[world.particles[i].id] = (uint32_t) i;
+            }
+        }
+
+        bool find(uint32_t id, uint32_t &index) const {
+            auto it = by_id.find(id);
+            if (it == by_id.end()) {
+                it = ghost_by_id.find(id);
+                if (it == ghost_by_id.end()) return false;
+            }
+            index = it->second;
+            return true;
+        }
+
+        Particle *find(uint32_t id) {
+            uint32_t index;
+            return find(id, index) ? &world.particles[index] : nullptr;
+        }
+
+        static JointState joint_state(const World &from, const Joint &j) {
+            return JointState{from.particles[j.p1].id, from.particles[j.p2].id, j.length(),
+                              from.joint_materials[j.material]};
+        }
+
+        JointState joint_state(const RemoteJoint &rj) const {
+            return JointState{rj.local_id, rj.remote_id, rj.length, world.joint_materials[rj.material]};
+        }
+
+        // First particle of the joint is local
+        void add_joint(const JointState &j) {
+            uint32_t p1, p2;
+            if (!find(j.id1, p1)) return;
+            uint16_t material = world.joint_material(j.material.stiffness, j.material.damping, j.material.clamp);
+            if (find(j.id2, p2)) {
+                world.spawn_joint_with_material(p1, p2, j.length, material);
+            } else {
+                remote_joints.push_back(RemoteJoint{j.id1, j.id2, j.length, material});
+            }
+        }
+
+        bool update(float delta_time) {
+            local_count = world.particles.size();
+
+            // Ghosts: copies of the neighbour particles near the borders, they are dropped after the step
+            std::vector<ParticleState> to_left, to_right, from_left, from_right;
+            for (auto &p : world.particles) {
+                if (!p.alive) continue;
+                ParticleState state{p.id, p.radius, p.position, p.velocity};
+                if (left >= 0 && p.position.x < lo + ghost_width) to_left.push_back(state);
+                if (right >= 0 && p.position.x >= hi - ghost_width) to_right.push_back(state);
+            }
+            if (!exchange(left, to_left, from_left) || !exchange(right, to_right, from_right)) return false;
+            for (auto &state : from_left) spawn(state);
+            for (auto &state : from_right) spawn(state);
+            index_ghosts();
+
+            world.update(delta_time);
+            world.particles.resize(local_count);
+            ghost_by_id.clear();
+            if (exchange_failed) return false;
+
+            return migrate();
+        }
+
+        // Joints to the neighbour particles are solved against their ghosts right after the local joints,
+        // as in a single world. The owners receive the velocity change of the ghosts before they integrate.
+        bool solve_remote_joints(float delta_time) {
+            // Ghost velocities are refreshed first - the neighbours have already solved their contacts and joints
+            std::vector<VelocityFeedback> to_left, to_right, from_left, from_right;
+            for (size_t i = 0; i < local_count; i++) {
+                const Particle &p = world.particles[i];
+                if (!p.alive) continue;
+                if (left >= 0 && p.position.x < lo + ghost_width) to_left.push_back(VelocityFeedback{p.id, p.velocity});
+                if (right >= 0 && p.position.x >= hi - ghost_width) to_right.push_back(VelocityFeedback{p.id, p.velocity});
+            }
+            if (!exchange(left, to_left, from_left) || !exchange(right, to_right, from_right)) return false;
+            for (auto *received : {&from_left, &from_right}) {
+                for (auto &state : *received) {
+                    Particle *ghost = find(state.id);
+                    if (ghost != nullptr) ghost->velocity = state.velocity;
+                }
+            }
+
+            std::vector<VelocityFeedback> feedback_left, feedback_right, received_left, received_right;
+            for (auto &rj : remote_joints) {
+                uint32_t local, ghost_index;
+                if (!find(rj.local_id, local) || !find(rj.remote_id, ghost_index)) continue;
+                Particle *ghost = &world.particles[ghost_index];
+
+                Joint joint{local, ghost_index};
+                joint.set_length(rj.length);
+                joint.material = rj.material;
+                vec2 velocity_before = ghost->velocity;
+                if (world.joint_solver == JointSolver::Xpbd) {
+                    world.solve_xpbd(&joint, delta_time);
+                } else {
+                    world.solve(&joint, delta_time);
+                }
+                VelocityFeedback feedback{rj.remote_id, ghost->velocity - velocity_before};
+                (ghost->position.x < lo ? feedback_left : feedback_right).push_back(feedback);
+            }
+            if (!exchange(left, feedback_left, received_left) || !exchange(right, feedback_right, received_right)) {
+                return false;
+            }
+            for (auto *received : {&received_left, &received_right}) {
+                for (auto &feedback : *received) {
+                    Particle *p = find(feedback.id);
+                    if (p != nullptr) p->velocity += feedback.velocity;
+                }
+            }
+            return true;
+        }
+
+        // Hands over particles that left the slab, joints go with their first particle
+        bool migrate() {
+            std::vector<ParticleState> to_left, to_right, from_left, from_right;
+            std::unordered_map<uint32_t, bool> moved_left; // id -> moved to the left neighbour
+            bool removed = false;
+            for (auto &p : world.particles) {
+                removed = removed || !p.alive;
+                if (!p.alive || owns(p.position.x)) continue;
+                bool is_left = p.position.x < lo;
+                (is_left ? to_left : to_right).push_back(ParticleState{p.id, p.radius, p.position, p.velocity});
+                moved_left[p.id] = is_left;
+                p.alive = false;
+            }
+
+            std::vector<JointState> joints_left, joints_right, joints_from_left, joints_from_right;
+            auto hand_over = [&](const JointState &j) {
+                auto it = moved_left.find(j.id1);
+                if (it != moved_left.end()) {
+                    (it->second ? joints_left : joints_right).push_back(j);
+                }
+            };
+            for (size_t i = 0; !moved_left.empty() && i < world.joints.size(); i++) {
+                const Joint &j = world.joints[i];
+                const Particle &p1 = world.particles[j.p1], &p2 = world.particles[j.p2];
+                if (!p1.alive) {
+                    hand_over(joint_state(world, j));
+                } else if (!p2.alive && moved_left.count(p2.id)) {
+                    remote_joints.push_back(RemoteJoint{p1.id, p2.id, j.length(), j.material});
+                }
+            }
+            remote_joints.erase(std::remove_if(remote_joints.begin(), remote_joints.end(), [&](const RemoteJoint &rj) {
+                Particle *local = find(rj.local_id);
+                if (local != nullptr && local->alive) return false;
+                hand_over(joint_state(rj));
+                return true;
+            }), remote_joints.end());
+
+            // Compacting copies all particles and invalidates the index, skip it when nothing left
+            removed = removed || !moved_left.empty();
+            if (removed) world.remove_dead_particles();
+
+            if (!exchange(left, to_left, from_left) || !exchange(right, to_right, from_right)) return false;
+            if (!exchange(left, joints_left, joints_from_left) || !exchange(right, joints_right, joints_from_right)) {
+                return false;
+            }
+            for (auto &state : from_left) spawn(state);
+            for (auto &state : from_right) spawn(state);
+            if (removed || !from_left.empty() || !from_right.empty()) index_particles();
+            for (auto &j : joints_from_left) add_joint(j);
+            for (auto &j : joints_from_right) add_joint(j);
+
+            // Joints whose second particle has just arrived become local
+            remote_joints.erase(std::remove_if(remote_joints.begin(), remote_joints.end(), [&](const RemoteJoint &rj) {
+                uint32_t p1, p2;
+                if (!find(rj.local_id, p1) || !find(rj.remote_id, p2)) return false;
+                world.spawn_joint_with_material(p1, p2, rj.length, rj.material);
+                return true;
+            }), remote_joints.end());
+            return true;
+        }
+
+        World world;
+        float lo = 0.0f;
+        float hi = 0.0f;
+        float ghost_width = 0.0f;
+
+        int control = -1;
+        int left = -1;
+        int right = -1;
+
+        std::vector<RemoteJoint> remote_joints;
+        bool exchange_failed = false;
+        size_t local_count = 0; // particles before the ghosts
+        std::unordered_map<uint32_t, uint32_t> by_id; // id -> index in world.particles, local particles
+        std::unordered_map<uint32_t, uint32_t> ghost_by_id; // the same for ghosts
+    };
+
+}
+
+PartitionedWorld::~PartitionedWorld() {
+    stop();
+}
+
+bool PartitionedWorld::start(const World &world, int workers_count, float x_min, float x_max) {
+    if (!workers.empty() || workers_count < 1 || !world.volumes.empty()) {
+        return false;
+    }
+
+    // control[i]: parent end, worker end; neighbours[i]: worker i end, worker i + 1 end
+    std::vector<std::array<int, 2>> control(workers_count, {-1, -1}), neighbours(workers_count - 1, {-1, -1});
+    auto close_sockets = [&]() {
+        for (auto *pairs : {&control, &neighbours}) {
+            for (auto &pair : *pairs) {
+                for (int fd : pair) if (fd >= 0) close(fd);
+            }
+        }
+    };
+    // Workers that are already running see the end of their control socket and exit
+    auto fail = [&]() {
+        close_sockets();
+        for (int pid : workers) {
+            waitpid(pid, nullptr, 0);
+        }
+        workers.clear();
+        return false;
+    };
+
+    for (auto *pairs : {&control, &neighbours}) {
+        for (auto &pair : *pairs) {
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair.data()) != 0) {
+                pair = {-1, -1};
+                return fail();
+            }
+        }
+    }
+
+    const float infinity = std::numeric_limits<float>::infinity();
+    for (int i = 0; i < workers_count; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            return fail();
+        }
+        if (pid == 0) {
+            Worker worker;
+            worker.lo = i == 0 ? -infinity : x_min + (x_max - x_min) * i / workers_count;
+            worker.hi = i + 1 == workers_count ? infinity : x_min + (x_max - x_min) * (i + 1) / workers_count;
+            worker.ghost_width = ghost_width;
+            worker.control = control[i][1];
+            worker.left = i > 0 ? neighbours[i - 1][1] : -1;
+            worker.right = i + 1 < workers_count ? neighbours[i][0] : -1;
+
+            for (auto &pair : control) {
+                for (int fd : pair) if (fd != worker.control) close(fd);
+            }
+            for (auto &pair : neighbours) {
+                for (int fd : pair) if (fd != worker.left && fd != worker.right) close(fd);
+            }
+            for (int fd : {worker.left, worker.right}) {
+                if (fd >= 0) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            }
+
+            worker.init(world);
+            worker.run();
+            _exit(0);
+        }
+        workers.push_back(pid);
+    }
+
+    for (auto &pair : control) {
+        control_sockets.push_back(pair[0]);
+        pair[0] = -1; // owned by control_sockets now
+    }
+    close_sockets();
+    return true;
+}
+
+bool PartitionedWorld::update(float delta_time) {
+    if (control_sockets.empty()) {
+        return false;
+    }
+    bool ok = true;
+    char command = 'U';
+    for (int fd : control_sockets) {
+        ok = write_all(fd, &command, 1) && write_all(fd, &delta_time, sizeof(delta_time)) && ok;
+    }
+    for (int fd : control_sockets) {
+        ok = read_all(fd, &command, 1) && ok; // a worker that is alive answers even if another one failed
+    }
+    return ok;
+}
+
+bool PartitionedWorld::gather(std::vector<ParticleState> &result) {
+    result.clear();
+    counts.clear();
+    if (control_sockets.empty()) {
+        return false;
+    }
+    char command = 'G';
+    std::vector<ParticleState> states;
+    for (int fd : control_sockets) {
+        states.clear();
+        if (!write_all(fd, &command, 1) || !receive_vector(fd, states)) {
+            return false;
+        }
+        result.insert(result.end(), states.begin(), states.end());
+        counts.push_back(states.size());
+    }
+    return true;
+}
+
+const std::vector<size_t> &PartitionedWorld::gathered_counts() const {
+    return counts;
+}
+
+void PartitionedWorld::stop() {
+    char command = 'Q';
+    for (int fd : control_sockets) {
+        write_all(fd, &command, 1);
+        close(fd);
+    }
+    for (int pid : workers) {
+        waitpid(pid, nullptr, 0);
+    }
+    control_sockets.clear();
+    workers.clear();
+}
+
+#else
+
+PartitionedWorld::~PartitionedWorld() = default;
+
+bool PartitionedWorld::start(const World &, int, float, float) {
+    return false; // needs fork and local sockets
+}
+
+bool PartitionedWorld::update(float) {
+    return false;
+}
+
+bool PartitionedWorld::gather(std::vector<ParticleState> &result) {
+    result.clear();
+    return false;
+}
+
+const std::vector<size_t> &PartitionedWorld::gathered_counts() const {
+    return counts;
+}
+
+void PartitionedWorld::stop() {}
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include "model.hpp"
+
+// Particle as it is sent between the worker processes
+struct ParticleState {
+    uint32_t id = 0;
+    float radius = 0.0f;
+    vec2 position = vec2();
+    vec2 velocity = vec2();
+};
+
+struct JointState {
+    uint32_t id1 = 0;
+    uint32_t id2 = 0;
+    float length = 0.0f;
+    JointMaterial material;
+};
+
+// Splits the world into vertical slabs, each one is simulated by its own worker process (POSIX only, fork).
+// Every update neighbour workers exchange ghost copies of the particles near the common border
+// and hand over the particles that crossed it. A joint is solved by the owner of its first particle,
+// against the ghost of the second one when it lives in the neighbour slab; the velocity change
+// of the ghost is sent back to its owner in the same update.
+// Inflated bodies are not supported. Joints must be shorter than ghost_width.
+struct PartitionedWorld {
+    PartitionedWorld() = default;
+
+    PartitionedWorld(const PartitionedWorld &) = delete;
+
+    ~PartitionedWorld();
+
+    // Forks workers_count workers, slab borders are spread evenly over [x_min; x_max] and
+    // the outer slabs are unbounded. Call it before any other threads are started.
+    bool start(const World &world, int workers_count, float x_min, float x_max);
+
+    // False when a worker has exited (all of them stop then), the partitioned world can only be stopped after that
+    bool update(float delta_time);
+
+    // Current particles of all workers, false when a worker has exited
+    bool gather(std::vector<ParticleState> &result);
+
+    // Particles per worker after the last gather
+    const std::vector<size_t> &gathered_counts() const;
+
+    void stop();
+
+    float ghost_width = 0.5f;
+
+private:
+    std::vector<int> workers;         // process ids
+    std::vector<int> control_sockets; // parent side
+    std::vector<size_t> counts;
+};
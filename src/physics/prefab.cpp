@@ -0,0 +1,63 @@
+#include "prefab.hpp"
+
+Prefab make_soft_box_prefab(vec2 half_size, float radius, float stiffness, float damping) {
+    Prefab prefab;
+    float gap = radius * 2 * 1.2f;
+    float diagonal = gap * sqrtf(2);
+
+    int size_x = half_size.x / gap;
+    int size_y = half_size.y / gap;
+    int column = 2 * size_y + 1;
+
+    prefab.particles.reserve((2 * size_x + 1) * column);
+    prefab.joints.reserve(prefab.particles.capacity() * 4);
+
+    for (int i = -size_x; i <= size_x; i++) {
+        for (int j = -size_y; j <= size_y; j++) {
+            vec2 noise = vec2(sin(j) * 0.01f, cos(j) * 0.01f);
+            prefab.particles.push_back(Particle{radius, (vec2(i, j) + noise) * gap});
+
+            auto index = (uint32_t) prefab.particles.size() - 1;
+            if (i > -size_x) {
+                prefab.joints.push_back(PrefabJoint{index, index - column, gap, stiffness, damping});
+            }
+            if (j > -size_y) {
+                prefab.joints.push_back(PrefabJoint{index, index - 1, gap, stiffness, damping});
+            }
+            if (j > -size_y && i > -size_x) {
+                prefab.joints.push_back(PrefabJoint{index, index - column - 1, diagonal, stiffness, damping});
+            }
+            if (j < size_y && i > -size_x) {
+                prefab.joints.push_back(PrefabJoint{index, index - column + 1, diagonal, stiffness, damping});
+            }
+        }
+    }
+    return prefab;
+}
+
+Prefab make_inflated_prefab(int n, float size, float radius, float stiffness, float damping) {
+    Prefab prefab;
+    prefab.particles.reserve(n);
+    prefab.joints.reserve(n);
+
+    for (int i = 0; i < n; i++) {
+        float angle = (2.0f * (float) i * (float) M_PI / (float) n);
+        prefab.particles.push_back(Particle{radius, vec2(cos(angle), sin(angle)) * size});
+    }
+    for (int i = 1; i <= n; i++) {
+        auto p1 = (uint32_t) (i == n ? n - 1 : i);
+        auto p2 = (uint32_t) (i == n ? 0 : i - 1); // the last one closes the ring
+        float length = distance(prefab.particles[p1].position, prefab.particles[p2].position);
+        prefab.joints.push_back(PrefabJoint{p1, p2, length, stiffness, damping});
+    }
+
+    // Rest volume as calculate_volume sees it, at the outside pressure, so the body keeps its shape
+    for (int i = 0; i < n; i++) {
+        vec2 p1 = prefab.particles[i].position;
+        vec2 p2 = prefab.particles[i + 1 == n ? 0 : i + 1].position;
+        prefab.volume += cross(vec3(p1, 0), vec3(p2, 0)).z;
+    }
+    prefab.pressure = 1.0f;
+    prefab.inflated = true;
+    return prefab;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+#include "model.hpp"
+
+struct PrefabJoint {
+    uint32_t p1 = 0; // indices in Prefab::particles
+    uint32_t p2 = 0;
+    float length = 0.0f;
+    float stiffness = 0.0f;
+    float damping = 0.0f;
+};
+
+// Topology of a body, built once and spawned many times with World::spawn_prefab
+struct Prefab {
+    std::vector<Particle> particles; // positions relative to the origin of the body
+    std::vector<PrefabJoint> joints;
+
+    // All particles in order form the outline of an inflated body
+    bool inflated = false;
+    float volume = 0.0f;
+    float pressure = 0.0f;
+};
+
+struct PrefabInstance {
+    vec2 position = vec2();
+    float angle = 0.0f;
+};
+
+// Grid of particles with joints to the neighbours and diagonals
+Prefab make_soft_box_prefab(vec2 half_size, float radius, float stiffness, float damping);
+
+// Ring of n particles joined one after another, inflated.
+// The volume is the one of the ring as spawned, the pressure is one atmosphere - raise it for a firmer body.
+Prefab make_inflated_prefab(int n, float size, float radius, float stiffness, float damping);
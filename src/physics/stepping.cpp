@@ -0,0 +1,49 @@
+#include "stepping.hpp"
+
+namespace {
+
+    // Sub-steps for a float estimate, clamped before the cast - inf, NaN or huge values give the limit
+    int to_substeps(float value, int limit) {
+        if (!(value < (float) limit)) {
+            return limit;
+        }
+        return (int) ceil(max(value, 1.0f));
+    }
+
+}
+
+int StepController::choose_substeps(const World &world, float delta_time) {
+    const WorldStats &stats = world.stats;
+    int previous = substeps == 0 ? max_substeps : substeps;
+
+    // CFL condition: displacement per sub-step must stay below a fraction of the smallest radius
+    int result = min_substeps;
+    if (stats.min_radius > 0.0f) {
+        float displacement = stats.max_velocity * delta_time / (stats.min_radius * max_displacement);
+        result = max(result, to_substeps(displacement, max_substeps));
+    }
+
+    // Stretched joints - increase proportionally to the strain.
+    // XPBD joints stay stable at any time step, their strain is a deformation and not a sign of instability.
+    if (world.joint_solver != JointSolver::Xpbd && !(stats.max_joint_strain <= max_joint_strain)) { // NaN too
+        result = max(result, to_substeps(previous * stats.max_joint_strain / max_joint_strain, max_substeps));
+    }
+
+    // Energy grows faster than gravity can explain - simulation is blowing up
+    if (stats.kinetic_energy > min_tracked_energy && stats.kinetic_energy > last_energy * max_energy_growth) {
+        result = max_substeps;
+    }
+
+    return clamp(result, min_substeps, max_substeps);
+}
+
+int StepController::update(World &world, float delta_time) {
+    substeps = choose_substeps(world, delta_time);
+    last_energy = world.stats.kinetic_energy;
+    world.stats.substeps = substeps; // before the steps, so the metrics of this frame report it
+
+    for (int i = 0; i < substeps; i++) {
+        world.update(delta_time / substeps + 1e-6f);
+    }
+    return substeps;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "model.hpp"
+
+// Splits a frame into sub-steps of World::update. The count is picked from the state of the world
+// after the previous frame: fast small particles, stretched joints and growing energy ask for more sub-steps,
+// quiet scenes run with min_substeps.
+struct StepController {
+
+    // Steps the world by delta_time, returns the number of sub-steps (also reported in world.stats.substeps)
+    int update(World &world, float delta_time);
+
+    int choose_substeps(const World &world, float delta_time);
+
+    int min_substeps = 2;
+    int max_substeps = 10;
+
+    // Max distance a particle can travel during one sub-step, in its radii (CFL number)
+    float max_displacement = 0.5f;
+
+    // Joint strain above which the number of sub-steps grows (not used with JointSolver::Xpbd)
+    float max_joint_strain = 0.1f;
+
+    // Kinetic energy growth between frames that is treated as instability
+    float max_energy_growth = 1.5f;
+    float min_tracked_energy = 0.001f;
+
+    int substeps = 0;
+    float last_energy = 0.0f;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool: every worker has its own queue and takes tasks from the others when it is empty,
+// so a few slow tasks don't keep the rest of the cores idle
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads_count = 0); // 0 - one worker per hardware thread
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ~ThreadPool();
+
+    void submit(std::function<void()> task);
+
+    // Blocks until all submitted tasks are finished
+    void wait();
+
+    size_t size() const;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool pop(size_t index, std::function<void()> &task);
+
+    void worker(size_t index);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    std::atomic<size_t> queued{0};  // waiting in the queues
+    std::atomic<size_t> pending{0}; // queued or running
+    std::atomic<size_t> next_queue{0};
+    bool stopping = false;
+};
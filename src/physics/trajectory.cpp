@@ -0,0 +1,333 @@
+#include "trajectory.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+namespace {
+
+    const char k_magic[4] = {'L', 'W', 'T', 'R'};
+    const char k_index_magic[4] = {'L', 'W', 'T', 'I'};
+    const uint32_t k_version = 1;
+    const int k_columns = 5; // id, position x, position y, velocity x, velocity y
+
+    void put_varint(std::vector<uint8_t> &out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(uint8_t(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(uint8_t(value));
+    }
+
+    bool get_varint(const std::vector<uint8_t> &in, size_t &position, uint64_t &value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && position < in.size(); shift += 7) {
+            uint8_t byte = in[position++];
+            value |= uint64_t(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) return true;
+        }
+        return false;
+    }
+
+    uint64_t zigzag(int64_t value) {
+        return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+    }
+
+    int64_t unzigzag(uint64_t value) {
+        return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+
+    // 64-bit offsets, long is 32 bits on Windows
+    int64_t file_tell(std::FILE *file) {
+#ifdef _WIN32
+        return _ftelli64(file);
+#else
+        return ftello(file);
+#endif
+    }
+
+    bool file_seek(std::FILE *file, int64_t offset, int origin) {
+#ifdef _WIN32
+        return _fseeki64(file, offset, origin) == 0;
+#else
+        return fseeko(file, (off_t) offset, origin) == 0;
+#endif
+    }
+
+    bool valid_format(float quantization, uint32_t chunk_steps) {
+        return quantization > 0.0f && std::isfinite(quantization) && chunk_steps > 0;
+    }
+
+    template<typename T>
+    bool write_value(std::FILE *file, const T &value) {
+        return std::fwrite(&value, sizeof(T), 1, file) == 1;
+    }
+
+    template<typename T>
+    bool read_value(std::FILE *file, T &value) {
+        return std::fread(&value, sizeof(T), 1, file) == 1;
+    }
+
+}
+
+TrajectoryWriter::TrajectoryWriter(size_t ring_size) : ring(ring_size) {}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    close();
+}
+
+bool TrajectoryWriter::open(const std::string &path, float quantization_, uint32_t chunk_steps_) {
+    close();
+    if (!valid_format(quantization_, chunk_steps_) || ring.empty()) {
+        return false;
+    }
+    file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    quantization = quantization_;
+    chunk_steps = chunk_steps_;
+    head = tail = 0;
+    steps = chunk_size = 0;
+    chunk.clear();
+    chunk_offsets.clear();
+    closing = false;
+    failed = false;
+
+    if (std::fwrite(k_magic, 1, sizeof(k_magic), file) != sizeof(k_magic) || !write_value(file, k_version) ||
+        !write_value(file, quantization) || !write_value(file, chunk_steps)) {
+        std::fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    thread = std::thread([this]() { write_loop(); });
+    return true;
+}
+
+void TrajectoryWriter::record(const World &world) {
+    if (file == nullptr) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return head - tail < ring.size(); });
+    Frame &frame = ring[head % ring.size()];
+    lock.unlock();
+
+    // Only this thread writes to the frame until head moves, vectors keep their capacity
+    frame.ids.resize(world.particles.size());
+    frame.positions.resize(world.particles.size());
+    frame.velocities.resize(world.particles.size());
+    size_t i = 0;
+    for (auto &p : world.particles) {
+        frame.ids[i] = p.id;
+        frame.positions[i] = p.position;
+        frame.velocities[i] = p.velocity;
+        i++;
+    }
+
+    lock.lock();
+    head++;
+    changed.notify_all();
+}
+
+bool TrajectoryWriter::close() {
+    if (file == nullptr) {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    changed.notify_all();
+    thread.join();
+
+    bool ok = !failed && flush_chunk();
+    int64_t index_offset = file_tell(file);
+    ok = ok && index_offset >= 0;
+    for (auto offset : chunk_offsets) {
+        ok = ok && write_value(file, offset);
+    }
+    ok = ok && write_value(file, steps) && write_value(file, uint32_t(chunk_offsets.size())) &&
+         write_value(file, uint64_t(index_offset)) &&
+         std::fwrite(k_index_magic, 1, sizeof(k_index_magic), file) == sizeof(k_index_magic);
+    ok = std::fclose(file) == 0 && ok; // fclose flushes the buffer, it can fail too
+    file = nullptr;
+    return ok;
+}
+
+void TrajectoryWriter::write_loop() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return tail < head || closing; });
+        if (tail == head) {
+            return; // closing and nothing left
+        }
+        const Frame &frame = ring[tail % ring.size()];
+        lock.unlock();
+
+        encode(frame);
+
+        lock.lock();
+        tail++;
+        changed.notify_all();
+    }
+}
+
+void TrajectoryWriter::encode(const Frame &frame) {
+    size_t count = frame.ids.size();
+    put_varint(chunk, count);
+
+    for (int column = 0; column < k_columns; column++) {
+        auto &previous_column = previous[column];
+        previous_column.resize(count, 0); // new particles are coded against 0
+        for (size_t i = 0; i < count; i++) {
+            int64_t value;
+            switch (column) {
+                case 0: value = frame.ids[i]; break;
+                case 1: value = std::llround(frame.positions[i].x / quantization); break;
+                case 2: value = std::llround(frame.positions[i].y / quantization); break;
+                case 3: value = std::llround(frame.velocities[i].x / quantization); break;
+                default: value = std::llround(frame.velocities[i].y / quantization); break;
+            }
+            put_varint(chunk, zigzag(value - previous_column[i]));
+            previous_column[i] = value;
+        }
+    }
+
+    steps++;
+    if (++chunk_size == chunk_steps && !flush_chunk()) {
+        failed = true;
+    }
+}
+
+bool TrajectoryWriter::flush_chunk() {
+    if (chunk_size == 0) {
+        return true;
+    }
+    int64_t offset = file_tell(file);
+    bool ok = offset >= 0 && write_value(file, chunk_size) && write_value(file, uint32_t(chunk.size())) &&
+              std::fwrite(chunk.data(), 1, chunk.size(), file) == chunk.size();
+    chunk_offsets.push_back(uint64_t(offset));
+
+    // Every chunk starts from scratch, so it can be decoded without the previous ones
+    chunk.clear();
+    chunk_size = 0;
+    for (auto &column : previous) {
+        column.clear();
+    }
+    return ok;
+}
+
+TrajectoryReader::~TrajectoryReader() {
+    if (file != nullptr) {
+        std::fclose(file);
+    }
+}
+
+bool TrajectoryReader::open(const std::string &path) {
+    if (file != nullptr) {
+        std::fclose(file);
+    }
+    total_steps = 0;
+    chunk_offsets.clear();
+    chunk_index = SIZE_MAX;
+    decoded_step = SIZE_MAX;
+    file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    if (std::fread(magic, 1, sizeof(magic), file) != sizeof(magic) || std::memcmp(magic, k_magic, sizeof(magic)) != 0 ||
+        !read_value(file, version) || version != k_version ||
+        !read_value(file, quantization) || !read_value(file, chunk_steps) ||
+        !valid_format(quantization, chunk_steps)) {
+        return false;
+    }
+
+    uint32_t chunks_count = 0;
+    uint64_t index_offset = 0;
+    if (!file_seek(file, -20, SEEK_END) ||
+        !read_value(file, total_steps) || !read_value(file, chunks_count) || !read_value(file, index_offset) ||
+        std::fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        std::memcmp(magic, k_index_magic, sizeof(magic)) != 0) {
+        return false; // not closed properly
+    }
+
+    chunk_offsets.resize(chunks_count);
+    if (!file_seek(file, (int64_t) index_offset, SEEK_SET)) {
+        return false;
+    }
+    for (auto &offset : chunk_offsets) {
+        if (!read_value(file, offset)) return false;
+    }
+    return true;
+}
+
+size_t TrajectoryReader::steps() const {
+    return total_steps;
+}
+
+bool TrajectoryReader::load_chunk(size_t index) {
+    uint32_t size = 0, bytes = 0;
+    if (index >= chunk_offsets.size() ||
+        !file_seek(file, (int64_t) chunk_offsets[index], SEEK_SET) ||
+        !read_value(file, size) || !read_value(file, bytes)) {
+        return false;
+    }
+    chunk.resize(bytes);
+    if (std::fread(chunk.data(), 1, bytes, file) != bytes) {
+        return false;
+    }
+    chunk_index = index;
+    chunk_position = 0;
+    decoded_step = SIZE_MAX;
+    for (auto &column : previous) {
+        column.clear();
+    }
+    return true;
+}
+
+bool TrajectoryReader::read_step(size_t step, std::vector<uint32_t> &ids,
+                                 std::vector<vec2> &positions, std::vector<vec2> &velocities) {
+    if (file == nullptr || step >= total_steps) {
+        return false;
+    }
+
+    // Steps of a chunk are delta coded - continue from the last decoded one or start the chunk over
+    size_t index = step / chunk_steps;
+    if (index != chunk_index || (decoded_step != SIZE_MAX && step < decoded_step)) {
+        if (!load_chunk(index)) return false;
+    }
+    size_t next = decoded_step == SIZE_MAX ? index * chunk_steps : decoded_step + 1;
+
+    for (; next <= step; next++) {
+        uint64_t count = 0;
+        if (!get_varint(chunk, chunk_position, count)) return false;
+        for (auto &column : previous) {
+            column.resize(count, 0);
+            for (auto &value : column) {
+                uint64_t delta = 0;
+                if (!get_varint(chunk, chunk_position, delta)) return false;
+                value += unzigzag(delta);
+            }
+        }
+        decoded_step = next;
+    }
+
+    size_t count = previous[0].size();
+    ids.resize(count);
+    positions.resize(count);
+    velocities.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        ids[i] = uint32_t(previous[0][i]);
+        positions[i] = vec2(previous[1][i], previous[2][i]) * quantization;
+        velocities[i] = vec2(previous[3][i], previous[4][i]) * quantization;
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "model.hpp"
+
+// Trajectory file: steps are grouped in chunks, every step is stored column by column
+// (id, position x/y, velocity x/y). Values are quantized and each column is delta coded against
+// the previous step of the chunk (zigzag + varint), so a chunk can be decoded on its own.
+// The index of chunks is at the end of the file.
+
+// Records World state after every World::update (see World::trajectory). The arrays are copied
+// into a ring of preallocated frames, encoding and writing happen on a background thread.
+class TrajectoryWriter {
+public:
+    explicit TrajectoryWriter(size_t ring_size = 8);
+
+    TrajectoryWriter(const TrajectoryWriter &) = delete;
+
+    ~TrajectoryWriter();
+
+    // False for quantization <= 0, chunk_steps == 0, ring_size == 0 or when the file can't be created
+    bool open(const std::string &path, float quantization = 0.0001f, uint32_t chunk_steps = 64);
+
+    // Blocks only when the writer thread is a whole ring behind
+    void record(const World &world);
+
+    // Writes the rest of the data and the index, false when any write failed - the file is broken then.
+    // True when nothing is open.
+    bool close();
+
+private:
+    struct Frame {
+        std::vector<uint32_t> ids;
+        std::vector<vec2> positions;
+        std::vector<vec2> velocities;
+    };
+
+    void write_loop();
+
+    void encode(const Frame &frame);
+
+    bool flush_chunk();
+
+    std::FILE *file = nullptr;
+    float quantization = 0.0001f;
+    uint32_t chunk_steps = 64;
+
+    std::vector<Frame> ring;
+    size_t head = 0; // next frame to record
+    size_t tail = 0; // next frame to write
+    bool closing = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread thread;
+
+    // Owned by the writer thread
+    std::vector<uint8_t> chunk;
+    uint32_t chunk_size = 0; // steps in the current chunk
+    uint32_t steps = 0;
+    std::vector<int64_t> previous[5];
+    std::vector<uint64_t> chunk_offsets;
+    bool failed = false; // a write failed, read after the thread is joined
+};
+
+// Random access to the steps of a trajectory file, only the chunk of the step is decoded
+class TrajectoryReader {
+public:
+    TrajectoryReader() = default;
+
+    TrajectoryReader(const TrajectoryReader &) = delete;
+
+    ~TrajectoryReader();
+
+    // Closes the previous file, if any
+    bool open(const std::string &path);
+
+    size_t steps() const;
+
+    bool read_step(size_t step, std::vector<uint32_t> &ids, std::vector<vec2> &positions, std::vector<vec2> &velocities);
+
+private:
+    bool load_chunk(size_t index);
+
+    std::FILE *file = nullptr;
+    float quantization = 0.0001f;
+    uint32_t chunk_steps = 64;
+    uint32_t total_steps = 0;
+    std::vector<uint64_t> chunk_offsets;
+
+    // Decoding state, sequential reads continue from it
+    std::vector<uint8_t> chunk;
+    size_t chunk_index = SIZE_MAX;
+    size_t chunk_position = 0;
+    size_t decoded_step = SIZE_MAX; // step in the previous columns
+    std::vector<int64_t> previous[5];
+};
@@ -1,13 +1,20 @@
 #pragma once
 // WARNING: not the best code here :) Scene initialization, drawing and mouse/key controls
 
+#include <algorithm>
 #include <cmath>
 
 #include "application/window_renderer.hpp"
 #include "application/window_listener.hpp"
 #include "application/time_utils.hpp"
+#include "application/stats_overlay.hpp"
 
+#include "physics/allocation_counter.hpp"
+#include "physics/arena.hpp"
+#include "physics/metrics.hpp"
 #include "physics/model.hpp"
+#include "physics/prefab.hpp"
+#include "physics/stepping.hpp"
 
 #include <GL/glew.h>
 
@@ -19,69 +26,14 @@ public:
 
     void SpawnInflatedBody(vec2 position, int n, float size, float radius) {
         size *= 0.7f;
-        size_t start = world.particles.size();
-
-        std::vector<Particle *> particles;
-        for (int i = 0; i < n; i++) {
-            float angle = (2.0f * (float) i * (float) M_PI / (float) n);
-            vec2 v = vec2(cos(angle), sin(angle)) * size + position;
-            world.spawn_particle(v, radius);
-            if (i > 0) {
-                auto p1 = &world.particles.back();
-                auto p2 = &world.particles[i + start - 1];
-                world.joints.push_back(Joint{p1, p2, distance(p1->position, p2->position), 6.0f, 0.2f});
-            }
-            particles.push_back(&world.particles.back());
-        }
-
-        {
-            auto p1 = &world.particles.back();
-            auto p2 = &world.particles[start];
-            world.joints.push_back(Joint{p1, p2, distance(p1->position, p2->position), 6.0f, 0.2f});
-        }
-
-        world.volumes.push_back(InflatedBody{particles, 4.0, (float) (size * size * M_PI)});
+        Prefab prefab = make_inflated_prefab(n, size, radius, 6.0f, 0.2f);
+        prefab.volume = 4.0f;
+        prefab.pressure = (float) (size * size * M_PI);
+        world.spawn_prefab(prefab, position);
     }
 
     void SpawnSoftBox(vec2 position, vec2 half_size, float angle = 0.0f, float radius = 0.05f) {
-        float gap = radius * 2 * 1.2f;
-
-        int size_x = half_size.x / gap;
-        int size_y = half_size.y / gap;
-
-        int start = world.particles.size();
-
-        float stiffness = 4.5;
-
-        for (int i = -size_x; i <= size_x; i++) {
-            for (int j = -size_y; j <= size_y; j++) {
-                vec2 noise = vec2(sin(j) * 0.01f, cos(j) * 0.01f);
-                world.spawn_particle(rotate2d((vec2(i, j) + noise) * gap, angle) + position, radius);
-
-                auto p1 = &world.particles.back();
-
-                if (i > -size_x) {
-                    int index = start + (i + size_x - 1) * (2 * size_y + 1) + (j + size_y);
-                    auto p2 = &world.particles[index];
-                    world.joints.push_back(Joint{p1, p2, gap, stiffness, 0.2f});
-                }
-                if (j > -size_y) {
-                    int index = start + (i + size_x) * (2 * size_y + 1) + (j + size_y - 1);
-                    auto p2 = &world.particles[index];
-                    world.joints.push_back(Joint{p1, p2, gap, stiffness, 0.2f});
-                }
-                if (j > -size_y && i > -size_x) {
-                    int index = start + (i + size_x - 1) * (2 * size_y + 1) + (j + size_y - 1);
-                    auto p2 = &world.particles[index];
-                    world.joints.push_back(Joint{p1, p2, gap * sqrtf(2), stiffness, 0.2f});
-                }
-                if (j < size_y && i > -size_x) {
-                    int index = start + (i + size_x - 1) * (2 * size_y + 1) + (j + size_y + 1);
-                    auto p2 = &world.particles[index];
-                    world.joints.push_back(Joint{p1, p2, gap * sqrtf(2), stiffness, 0.2f});
-                }
-            }
-        }
+        world.spawn_prefab(make_soft_box_prefab(half_size, radius, 4.5f, 0.2f), position, angle);
     }
 
     bool Init(SDL_Window *window, SDL_GLContext context) override {
@@ -95,6 +47,10 @@ public:
     }
 
     void Redraw() override {
+        lit::common::scoped_timer render_timer(stats.render);
+        frame_arena.reset();
+        NoAllocationGuard no_allocations(steady_frames >= k_warmup_frames);
+
         SDL_GetWindowSize(sdl_window, &width, &height);
         glLoadIdentity();
         glOrtho(-width / 2, width / 2, height / 2, -height / 2, 0, 1);
@@ -108,11 +64,12 @@ public:
         DrawGrid(1, {0.9, 0.9, 0.9});
 
         for (const auto &j : world.joints) {
-            DrawLine(j.p1->position, j.p2->position, {0.55, 0.55, 0.55});
+            DrawLine(world.particles[j.p1].position, world.particles[j.p2].position, {0.55, 0.55, 0.55});
         }
 
         for (const auto &v : world.volumes) {
-            std::vector<vec2> vertices;
+            ArenaVector<vec2> vertices{ArenaAllocator<vec2>(frame_arena)};
+            vertices.reserve(v.particles.size());
             vec2 center = vec2();
             for (auto p: v.particles) {
                 vertices.push_back(p->position);
@@ -138,6 +95,10 @@ public:
     }
 
     void InitWorld() {
+        world.warm_starting = true;
+        world.continuous_collision = true;
+        world.joint_solver = JointSolver::Xpbd;
+
         world.spawn_box(vec2(0, 3), vec2(4, 0.2), 0);
         world.spawn_box(vec2(+5, 2.5), vec2(0.2, 0.5), 0.1f);
         world.spawn_box(vec2(-5, 2.5), vec2(0.2, 0.5), -0.1f);
@@ -149,7 +110,19 @@ public:
 
     bool ProcessEvent(const SDL_Event &event) override {
         static int type = 0;
+        if (event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_RIGHT) {
+            // push away everything around the cursor
+            vec2 pos = ScreenToWorld(event.button.x, event.button.y);
+            world.query_radius(pos, 1.0f, picked);
+            for (auto p : picked) {
+                vec2 direction = p->position - pos;
+                p->velocity += direction / (length(direction) + 0.1f) * 3.0f;
+            }
+            changed = true;
+            return false;
+        }
         if (event.type == SDL_MOUSEBUTTONDOWN) {
+            changed = true;
             vec2 pos = ScreenToWorld(event.motion.x, event.motion.y);
             static int t = 0; t++; // just a number sequence, to generate some "random" numbers with sin, cos
             if (type == 0) {
@@ -178,10 +151,41 @@ public:
     void StartFrameEvent() override {
         auto delta_time = (float) timer.get_elapsed_seconds();
         timer.reset();
+        if (awake) {
+            stats.frame.record(delta_time); // otherwise it is the idle time
+        }
+        // Long pauses (sleep, dragging the window) are not simulated at once
+        delta_time = std::min(delta_time, k_max_delta_time);
 
-        for (int i = 0; i < k_physics_iterations_per_frame; i++) {
-            world.update(delta_time / k_physics_iterations_per_frame + 1e-6f);
+        // Spawning and the first steps after it allocate, after that the frame must not
+        steady_frames = changed ? 0 : steady_frames + 1;
+        NoAllocationGuard no_allocations(steady_frames >= k_warmup_frames);
+        {
+            lit::common::scoped_timer physics_timer(stats.physics);
+            stepper.update(world, delta_time);
         }
+        stats.SetCounter("particles", (double) world.stats.live_particles);
+        stats.SetCounter("contacts", (double) world.stats.contacts);
+        stats.SetCounter("joints", (double) world.stats.joints);
+        stats.SetCounter("substeps", world.stats.substeps);
+
+        // Sleep only after some quiet frames - a spawned particle has zero velocity before its first step
+        quiet_frames = world.stats.max_velocity > k_sleep_velocity ? 0 : quiet_frames + 1;
+        awake = quiet_frames < k_frames_to_sleep;
+        changed = false;
+    }
+
+    // Nothing to redraw while the world is at rest and there is no input
+    bool NeedsRedraw() override {
+        return awake || changed;
+    }
+
+    void ExportMetrics(MetricsServer *server) {
+        world.metrics = server;
+    }
+
+    const FrameStats &GetStats() const {
+        return stats;
     }
 
 private:
@@ -240,7 +244,7 @@ private:
     }
 
     void
-    DrawPolygon(const std::vector<vec2> &vertices, vec2 center, Color color, bool fill = false, float alpha = 1.0f) {
+    DrawPolygon(const ArenaVector<vec2> &vertices, vec2 center, Color color, bool fill = false, float alpha = 1.0f) {
         glColor4f(color.r, color.g, color.b, alpha);
         if (fill) {
             glBegin(GL_TRIANGLE_FAN);
@@ -277,12 +281,23 @@ private:
     SDL_Window *sdl_window{};
     lit::common::timer timer;
     World world;
+    StepController stepper;
+    FrameStats stats;
+    FrameArena frame_arena{64 * 1024}; // temporaries of Redraw
+
+    static constexpr float k_max_delta_time = 0.05f;
+    static constexpr float k_sleep_velocity = 0.01f;
+    static constexpr int k_frames_to_sleep = 30;
+    int quiet_frames = 0;
+    static constexpr int k_warmup_frames = 60;
+    int steady_frames = 0;
+    bool awake = true;
+    bool changed = true;
+    std::vector<Particle *> picked;
 
     int width = 512;
     int height = 512;
 
-    const int k_physics_iterations_per_frame = 10;
-
     float scale = 1.0;
     vec2 screen_center = vec2();
 };
\ No newline at end of file
@@ -0,0 +1,39 @@
+// query_nearest against brute force, including query points far outside of the grid
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include "physics/model.hpp"
+
+int main() {
+    World world;
+    world.gravity = vec2();
+    for (int i = 0; i < 100; i++) {
+        world.spawn_particle(vec2(-13.5f + i * 0.27f, (float) (i % 7) - 3.0f), 0.05f);
+    }
+    world.update(0.001f); // builds the grid
+
+    const vec2 points[] = {vec2(0, 0), vec2(5, -2), vec2(40, 0), vec2(100, 100), vec2(-30, 5), vec2(0, -60)};
+    const size_t ks[] = {1, 5, 100, 1000};
+    int failures = 0;
+    std::vector<Particle *> result;
+    for (vec2 point : points) {
+        std::vector<float> expected;
+        for (auto &p : world.particles) {
+            expected.push_back(distance(point, p.position));
+        }
+        std::sort(expected.begin(), expected.end());
+
+        for (size_t k : ks) {
+            world.query_nearest(point, k, result);
+            bool ok = result.size() == std::min(k, expected.size());
+            for (size_t i = 0; ok && i < result.size(); i++) {
+                ok = distance(point, result[i]->position) == expected[i];
+            }
+            if (!ok) {
+                std::printf("query_nearest((%g, %g), %zu) returned %zu particles\n", point.x, point.y, k, result.size());
+                failures++;
+            }
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
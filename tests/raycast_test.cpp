@@ -0,0 +1,50 @@
+// raycast against brute force, rays that miss everything must return even with a huge or infinite length
+#include <cmath>
+#include <cstdio>
+#include "physics/model.hpp"
+
+int main() {
+    World world;
+    world.gravity = vec2();
+    for (int i = 0; i < 100; i++) {
+        world.spawn_particle(vec2(-13.5f + i * 0.27f, (float) (i % 7) - 3.0f), 0.05f);
+    }
+    world.update(0.001f); // builds the grid
+
+    int failures = 0;
+    const float lengths[] = {10.0f, 1e8f, INFINITY};
+    for (float max_distance : lengths) {
+        // Between the rows of particles, nothing to hit
+        if (world.raycast(vec2(1, 0.5f), vec2(1, 0), max_distance).has_value() ||
+            world.raycast(vec2(-100, 0.5f), vec2(1, 0), max_distance).has_value()) {
+            std::printf("raycast with max distance %g hit something\n", max_distance);
+            failures++;
+        }
+    }
+
+    // Grazing hits depend on rounding, so the nearest hit is bounded by particles with smaller
+    // and larger radii
+    const vec2 origins[] = {vec2(0, 0), vec2(-20, 1), vec2(30, -2), vec2(3, 40)};
+    for (vec2 origin : origins) {
+        for (auto &target : world.particles) {
+            vec2 direction = normalize(target.position - origin);
+            double nearest_inner = INFINITY, nearest_outer = INFINITY;
+            for (auto &p : world.particles) {
+                double dx = p.position.x - origin.x, dy = p.position.y - origin.y;
+                double projection = dx * direction.x + dy * direction.y;
+                double dist_sqr = dx * dx + dy * dy - projection * projection;
+                double inner = p.radius * 0.9, outer = p.radius * 1.1;
+                if (projection < 0.0) continue;
+                if (dist_sqr <= inner * inner) nearest_inner = std::fmin(nearest_inner, projection - std::sqrt(inner * inner - dist_sqr));
+                if (dist_sqr <= outer * outer) nearest_outer = std::fmin(nearest_outer, projection - std::sqrt(outer * outer - dist_sqr));
+            }
+            auto hit = world.raycast(origin, direction, INFINITY);
+            const double tolerance = 1e-3;
+            if (!hit.has_value() || hit->distance > nearest_inner + tolerance || hit->distance < nearest_outer - tolerance) {
+                std::printf("raycast from (%g, %g) to (%g, %g) missed\n", origin.x, origin.y, target.position.x, target.position.y);
+                failures++;
+            }
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
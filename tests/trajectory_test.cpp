@@ -0,0 +1,98 @@
+// Trajectory file round trip: every recorded step reads back within the quantization, in order and out of order
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "physics/model.hpp"
+#include "physics/trajectory.hpp"
+
+namespace {
+
+    struct Step {
+        std::vector<uint32_t> ids;
+        std::vector<vec2> positions;
+        std::vector<vec2> velocities;
+    };
+
+    bool same(const Step &expected, const Step &actual, float quantization) {
+        if (expected.ids != actual.ids) return false;
+        // Rounding to the grid is off by half a step at most, the slack is for the float arithmetic
+        float tolerance = quantization * 0.5f + 1e-5f;
+        for (size_t i = 0; i < expected.ids.size(); i++) {
+            vec2 position = abs(expected.positions[i] - actual.positions[i]);
+            vec2 velocity = abs(expected.velocities[i] - actual.velocities[i]);
+            if (max(max(position.x, position.y), max(velocity.x, velocity.y)) > tolerance) return false;
+        }
+        return true;
+    }
+
+}
+
+int main() {
+    const char *path = "trajectory_test.bin";
+    const float quantization = 0.001f;
+    const int steps = 150;
+    int failures = 0;
+
+    TrajectoryWriter writer;
+    TrajectoryWriter empty_ring(0);
+    if (writer.open(path, 0.0f) || writer.open(path, quantization, 0) || empty_ring.open(path, quantization)) {
+        std::printf("open accepted invalid parameters\n");
+        failures++;
+    }
+
+    World world;
+    world.spawn_box(vec2(0, 3), vec2(4, 0.2), 0);
+    for (int i = 0; i < 200; i++) {
+        world.spawn_particle(vec2(-3.0f + (i % 20) * 0.3f, -2.0f + (i / 20) * 0.3f), 0.1f);
+    }
+    if (!writer.open(path, quantization, 16)) {
+        std::printf("can't open %s\n", path);
+        return 1;
+    }
+    std::vector<Step> recorded;
+    world.trajectory = &writer;
+    for (int i = 0; i < steps; i++) {
+        if (i == 70) world.spawn_particle(vec2(0, -3), 0.1f); // new particle in the middle of a chunk
+        world.update(1.0f / 60);
+        Step step;
+        for (auto &p : world.particles) {
+            step.ids.push_back(p.id);
+            step.positions.push_back(p.position);
+            step.velocities.push_back(p.velocity);
+        }
+        recorded.push_back(step);
+    }
+    world.trajectory = nullptr;
+    if (!writer.close()) {
+        std::printf("close failed\n");
+        failures++;
+    }
+
+    TrajectoryReader reader;
+    // The second open must replace the first one
+    if (!reader.open(path) || !reader.open(path) || reader.steps() != (size_t) steps) {
+        std::printf("can't read %s back\n", path);
+        std::remove(path);
+        return 1;
+    }
+    Step step;
+    for (int i = 0; i < steps; i++) {
+        if (!reader.read_step(i, step.ids, step.positions, step.velocities) || !same(recorded[i], step, quantization)) {
+            std::printf("step %d differs\n", i);
+            failures++;
+        }
+    }
+    for (int i : {149, 3, 77, 76, 16, 15, 0}) {
+        if (!reader.read_step(i, step.ids, step.positions, step.velocities) || !same(recorded[i], step, quantization)) {
+            std::printf("step %d differs when read out of order\n", i);
+            failures++;
+        }
+    }
+    if (reader.read_step(steps, step.ids, step.positions, step.velocities)) {
+        std::printf("step past the end was read\n");
+        failures++;
+    }
+
+    std::remove(path);
+    return failures == 0 ? 0 : 1;
+}